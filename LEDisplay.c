@@ -8,15 +8,21 @@
 #include <fcntl.h>           /* Definition of AT_* constants */
 #include <unistd.h>
 
-static char rcsid[] = 
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <termios.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+
+#include "ledshm.h"
+#include "ledlayout.h"
+
+static char rcsid[] __attribute__((unused)) =
     "$Id: display.c,v 1.1 2006/09/26 18:48:13 kilroy Exp kilroy $";
 
-// 6 digits are the time: 12:34:56
-// slot 7 is for AM/PM/24H indicators
-digit digit_data[8];
-
-char title_bar[81];
-
 const int EXTRA = 7;
 const int INDICATOR_AM   = 0x01;
 const int INDICATOR_PM   = 0x02;
@@ -32,102 +38,118 @@ const int COLON_LR = 0x10;
 // First row of keys is fixed:
 char KeyStr[5][7] = { "24 Hr", "AM/PM", " Date", " Test", " Off" };
 
-// Second row of keys can be changed.
-char RowTwoKeys[5][7] = {"", "", "", "", ""};
+/* Everything about one LED panel.  The driver can run several at
+ * once, each on its own terminal; "current" is the one the functions
+ * in LEDisplay.h work on, and select_panel() changes it.
+ */
+struct panel {
+    // 6 digits are the time: 12:34:56
+    // slot 7 is for AM/PM/24H indicators
+    digit   digit_data[8];
+
+    char    title_bar[81];
+
+    // Second row of keys can be changed.
+    char    RowTwoKeys[5][7];
+
+    /* What is on the screen right now.  display() compares the buffers
+     * against these and only redraws the parts that changed; a full
+     * repaint happens on the first frame and after the window is resized.
+     */
+    digit   shown_data[8];
+    char    shown_title[81];
+    char    shown_keys[5][7];
+    int     full_redraw;
+
+    // where things go on its terminal; worked out again on a resize
+    struct layout layout;
+
+    SCREEN *screen;               // curses screen for this terminal
+    FILE   *tty;                  // NULL for our own terminal
+    char   *tty_name;
+    int     key_fd;               // where its keys come from
+    int     old_cursor_setting;
+    struct ledshm_panel *shared;  // its slot in the shared frame buffer
+    uint32_t outside_frames;      // the last frame another program drew
+    int     out_fd;               // the ANSI backend draws here ...
+    int     ansi_ready;           // ... once it has set the terminal up
+    struct termios saved_tty;     // and puts this back at the end
+    unsigned char input[64];      // part of an escape sequence, so far
+    int     input_len;
+    char   *background;           // the frame and fixed keys, as escapes
+    int     background_len;
+    int     number;               // 0 for ours, then 1, 2, ... as opened
+    panel  *next;                 // all the panels, for end_display()
+};
+
+static panel  main_panel = { .full_redraw = 1, .key_fd = STDIN_FILENO,
+                              .out_fd = STDOUT_FILENO };
+static panel *current = &main_panel;
+static panel *panels = &main_panel;
 
 
 // Layout of LEDs - changes every so often to deter cheating
-// This layout is Spring 2020
-const int TOP_HORIZ = 0x10 ;  // top horizontal bar
-const int MID_HORIZ = 0x20 ;  // middle horizontal bar
+// This layout matches LED-layout.txt
+const int TOP_HORIZ = 0x01 ;  // top horizontal bar
+const int MID_HORIZ = 0x08 ;  // middle horizontal bar
 const int BOT_HORIZ = 0x40 ;  // bottom horizontal bar
 
-const int UL_VERT   = 0x01 ;  // upper-left vertical bar
-const int LL_VERT   = 0x02 ;  // lower-left vertical bar
+const int UL_VERT   = 0x02 ;  // upper-left vertical bar
+const int LL_VERT   = 0x10 ;  // lower-left vertical bar
 const int UR_VERT   = 0x04 ;  // upper-right vertical bar
-const int LR_VERT   = 0x08 ;  // lower-right vertical bar
+const int LR_VERT   = 0x20 ;  // lower-right vertical bar
 
 const int DECIMAL   = 0x80 ;  // decimal point
 
 
 digit *get_display_location()
 {
-     return &digit_data[0];
+     return &current->digit_data[0];
 }
 
 
-void start_display(void)
+/* CURSES BACKEND: the full-screen simulated panel */
+
+static void curses_display(void);
+
+static void curses_start(void)
 {
-    int  i;
     void init_screen(void);
-    void display(void);
-    char *showbits = getenv("SHOWCLOCKLEDBITS");
 
-    // only show bits, don't do fullscreen mode
-    if ( showbits && strcmp(showbits, "YES") == 0 ) {
-        printf("Showing bits: unset SHOWCLOCKLEDBITS to see LEDs.\n");
-        for (i = 0; i < 5; i++)
-            digit_data[i] = 0;
-        return;
-    }
-    
     init_screen();
-
-    for (i = 0; i < 5; i++)
-        digit_data[i] = 0;
-
-    display();
+    curses_display();
 }
 
-int old_cursor_setting;
-
-void end_display(void)
+static void curses_end(void)
 {
-    char *showbits = getenv("SHOWCLOCKLEDBITS");
-
-    // only show bits, don't do fullscreen mode
-    if ( showbits && strcmp(showbits, "YES") == 0 ) {
-        return;
+    panel *p;
+
+    for (p = panels; p != NULL; p = p->next) {
+        if ( p->screen == NULL )
+            continue;
+        set_term(p->screen);
+        nocbreak();
+        echo();
+        curs_set(p->old_cursor_setting);
+        endwin();
     }
-    
-    nocbreak();
-    echo();
-    curs_set(old_cursor_setting);    
-    endwin();
 }
 
-void init_screen(void)
+/* Put a freshly made curses screen into the modes the panel needs.
+ * "where" is for error messages.
+ */
+static void setup_screen(panel *p, char *where)
 {
-    int      status;
-    char    *term;
     int     winrows, wincols;
 
-    if ( access ("/home/kilroy/.elvis", F_OK) == -1 ) {
-        printf("This device driver was configured to run on Elvis.\n");
-        exit(1);
-    }
-
-    if ( ( term = getenv("TERM") ) == NULL ) {
-        printf("You have not set your TERM variable.");
-        exit(1);
-    }
-
-    setupterm(term, 1, &status);
-    if ( status != 1 ) {
-        printf("I can't find information for your %s terminal.", term);
-        exit(1);
-    }
-
-    initscr();
-
-    old_cursor_setting = curs_set(0);
+    p->old_cursor_setting = curs_set(0);
 
     // 2017-05-24 14:22:47 EDT (Wednesday)
     // https://www.linux.com/forums/command-line/ncurses-startcolor-screen-color
     if(has_colors() == FALSE) {    // Check the terminal has colour capability
         endwin();                // Close Window and leave ncurses
         fprintf(stderr,
-                "Your terminal does not support colour.   ");
+                "Your terminal %s does not support colour.   ", where);
         exit (1);
     }
     
@@ -147,7 +169,7 @@ void init_screen(void)
     keypad(stdscr, TRUE);
 
     if (mousemask(ALL_MOUSE_EVENTS, 0) == 0) {
-        fprintf(stderr, "No mouse\n");
+        fprintf(stderr, "No mouse on %s\n", where);
         exit(1);
     }
 
@@ -157,15 +179,59 @@ void init_screen(void)
         refresh();
         endwin();
         fprintf(stderr,
-                "Your window is %dx%d; must be at least 80x24.\n",
-                wincols, winrows);
+                "Your window %s is %dx%d; must be at least 80x24.\n",
+                where, wincols, winrows);
         exit (1);
     }
+
+    layout_panel(&p->layout, winrows, wincols, 6);
+    p->full_redraw = 1;
+}
+
+/* Make sure we can run here at all, and return the terminal type.
+ */
+static char *check_terminal(void)
+{
+    int      status;
+    char    *term;
+
+    if ( access ("/home/kilroy/.elvis", F_OK) == -1 ) {
+        printf("This device driver was configured to run on Elvis.\n");
+        exit(1);
+    }
+
+    if ( ( term = getenv("TERM") ) == NULL ) {
+        printf("You have not set your TERM variable.");
+        exit(1);
+    }
+
+    setupterm(term, 1, &status);
+    if ( status != 1 ) {
+        printf("I can't find information for your %s terminal.", term);
+        exit(1);
+    }
+
+    return term;
+}
+
+void init_screen(void)
+{
+    char    *term = check_terminal();
+
+    main_panel.screen = newterm(term, stdout, stdin);
+    if ( main_panel.screen == NULL ) {
+        printf("I can't start curses on your %s terminal.", term);
+        exit(1);
+    }
+
+    setup_screen(&main_panel, "");
 }
 
 void set_title_bar(char *title_bar_text)
 {
-     memcpy(title_bar, title_bar_text, 81);
+     // titles are usually 78 characters; don't read past the end
+     strncpy(current->title_bar, title_bar_text, 80);
+     current->title_bar[80] = '\0';
 }
 
 /* Draw a box with some text in it; used for keys.
@@ -198,255 +264,201 @@ void dobox(int top, int left, int height, int width, char *text)
     printw("%s", text);   
 }
 
-void display(void)
+// fill a rectangle with spaces in whatever colour is current
+static void fill(int top, int left, int height, int width)
 {
-    int  digit;
-    int  x, y;
+    for (int i = 0; i < height; i++)
+        mvprintw(top + i, left, "%*s", width, "");
+}
 
-    int  KeyOffsetX, KeyOffsetY;
-    int  Key;
+static void fill_rect(struct rect *r)
+{
+    fill(r->y, r->x, r->h, r->w);
+}
 
-    char *showbits = getenv("SHOWCLOCKLEDBITS");
+// paint the static parts: background, frame and the fixed keys
+static void draw_background(void)
+{
+    struct layout *l = &current->layout;
+    int Key;
 
-    // only show bits, don't do fullscreen mode
-    if ( showbits && strcmp(showbits, "YES") == 0 ) {
-        for (digit = 0; digit <=5 ; digit++) {
-            printf ("%d : 0x%x - ", digit, digit_data[digit]);
-        }
-        printf (" 7 : 0x%x \n", digit_data[7]);
-        return;
-    }    
-    
     erase();
 
-    // print 12 lines of 80 columns all in black (for LEDs)
+    // the LED area in black
     attron(COLOR_PAIR(2));
-    for (int i = 0; i < 12; i++) {
-        move(i,0);
-        printw("                                        "          
-               "                                        ");
-    }
+    fill(0, 0, l->divider, l->cols);
 
-    // print 12 lines of 80 columns all white (for buttons)
+    // and the key area
     attron(COLOR_PAIR(3));
-    for (int i = 12; i < 23; i++) {
-        move(i,0);
-        printw("                                        "          
-               "                                        ");
-    }
+    fill(l->divider, 0, l->bottom - l->divider + 1, l->cols);
+
     // print frame on left/right
-    for (int i = 0; i < 22; i++) {
+    for (int i = 0; i < l->bottom; i++) {
         move(i,0); printw("   ");
         move(i,1); addch(ACS_VLINE);
-        move(i,77); printw("   ");
-        move(i,78); addch(ACS_VLINE);        
+        move(i,l->cols-3); printw("   ");
+        move(i,l->cols-2); addch(ACS_VLINE);
+    }
+
+    // print frame along center (between areas), and along the bottom
+    for (int i=1; i < l->cols - 1; i++) {
+        move(l->divider,i); addch(ACS_HLINE);
+        move(l->bottom,i);  addch(ACS_HLINE);
+    }
+
+    // add corners (the top two go in with the title bar)
+    move(l->divider,1);         addch(ACS_LTEE);
+    move(l->divider,l->cols-2); addch(ACS_RTEE);
+    move(l->bottom,1);          addch(ACS_LLCORNER);
+    move(l->bottom,l->cols-2);  addch(ACS_LRCORNER);
+
+    // top row of fixed keys
+    for (Key = 0; Key < 5; Key++) {
+        struct rect *k = &l->key[0][Key];
+
+        dobox(k->y, k->x, k->h, k->w, KeyStr[Key]);
     }
+}
+
+// print frame along top, overwritten by the title bar
+static void draw_title(void)
+{
+    panel *p = current;
+    int    cols = p->layout.cols;
+    int    left = ( cols - 80 ) / 2 + 1;   // the title is in the middle
 
-    // print frame along top (overwritten by title bar)
     attron(COLOR_PAIR(3));
-    move(0,0);
-    printw("                                        "          
-           "                                        ");
-    move(0,1);
+    fill(0, 0, 1, cols);
+    for (int i=1; i < cols - 1; i++) {
+        move(0,i); addch(ACS_HLINE);
+    }
     for (int i=0; i < 78; i++) {
-        if (title_bar[i] == '-') {
-            move(0,1+i);
-            addch(ACS_HLINE);
-        } else if (title_bar[i] == ' ') {
+        move(0,left+i);
+        if (p->title_bar[i] == '-' || p->title_bar[i] == '\0') {
+            addch(ACS_HLINE);   // a short title leaves the frame showing
+        } else if (p->title_bar[i] == ' ') {
             printw(" ");
         } else {
-            printw("%c", title_bar[i]);
+            printw("%c", p->title_bar[i]);
         }
     }
+    move(0,1);       addch(ACS_ULCORNER);
+    move(0,cols-2);  addch(ACS_URCORNER);
+    memcpy(p->shown_title, p->title_bar, sizeof(p->shown_title));
+}
 
-    // print frame along center (between areas)
-    move(12,1);
-    for (int i=0; i < 78; i++) {
-        addch(ACS_HLINE);
-    }
+// second row of user-defined keys; a key is only drawn if it has text
+static void draw_row_two_key(int Key)
+{
+    panel *p = current;
+    struct rect *k = &p->layout.key[1][Key];
 
-    // print frame along bottom (below buttons)
-    move(22,1);
-    for (int i=0; i < 78; i++) {
-        move(22,1+i);
-        addch(ACS_HLINE);
-    }
-    
-    // add corners
-    move(0,1);   addch(ACS_ULCORNER);
-    move(0,78);  addch(ACS_URCORNER);    
-    move(12,1);  addch(ACS_LTEE);
-    move(12,78); addch(ACS_RTEE);
-    move(22,1);  addch(ACS_LLCORNER);
-    move(22,78); addch(ACS_LRCORNER);
-    
+    attron(COLOR_PAIR(3));
+    fill_rect(k);
+    if (strlen(p->RowTwoKeys[Key]) > 0)
+        dobox(k->y, k->x, k->h, k->w, p->RowTwoKeys[Key]);
+    memcpy(p->shown_keys[Key], p->RowTwoKeys[Key], sizeof(p->shown_keys[0]));
+}
+
+/* Black out one digit's cell and light whichever segments are on.
+ * Segments share their corner cells, so redrawing the whole cell is
+ * simpler than working out which cells a segment may switch off.
+ */
+static void draw_digit(int d)
+{
+    panel *p = current;
+    digit bits = p->digit_data[d];
+    int   segment;
 
-    // set to black text on red background; makes spaces red
+    attron(COLOR_PAIR(2));
+    fill_rect(&p->layout.digit[d]);
+
+    // set to black text on red background; makes spaces red;
+    // bit n is segment n, as in LED-layout.txt
     attron(COLOR_PAIR(1));
-    // draw the colons
-    if ( digit_data[EXTRA] & COLON_UL ) {
-        move(5, 27);
-        printw("  ");
-    }
-    if ( digit_data[EXTRA] & COLON_LL ) {
-        move(7, 27);
-        printw("  ");
+    for (segment = 0; segment < 8; segment++) {
+        if (bits & (1 << segment))
+            fill_rect(&p->layout.segment[d][segment]);
     }
 
-    if ( digit_data[EXTRA] & COLON_UR ) {
-        move(5, 48);
-        printw("  ");
-    }
-    if ( digit_data[EXTRA] & COLON_LR ) {
-        move(7, 48);
-        printw("  ");
-    }
+    p->shown_data[d] = bits;
+}
 
-    /* This draws the 6 digits.
-     */
-    for (digit = 0; digit <=5 ; digit++) {
-        x = digit * 9 + 10;
-        if (digit > 1) x += 3; // skip first set of colons
-        if (digit > 3) x += 3; // skip second set of colons
-        y = 3;
-
-        // top segment
-        if (digit_data[digit] & TOP_HORIZ) {
-            move(y, x);
-            printw("      ");
-        }
+// one colon dot: red if lit, black if not
+static void draw_dot(int lit, struct rect *r)
+{
+    attron(COLOR_PAIR(lit ? 1 : 2));
+    fill_rect(r);
+}
 
-        // upper segment on left
-        if (digit_data[digit] & UL_VERT) {
-            move(y, x);
-            // draw line between two segments
-            printw(" ");
-            move(y+1, x);
-            printw(" ");
-            move(y+2, x);
-            printw(" ");
-            move(y+3, x);
-            printw(" ");
-        }
+// one status LED: its label if lit, blanks if not
+static void draw_indicator(int lit, struct rect *r, char *label)
+{
+    attron(COLOR_PAIR(2)); // red text on black background
+    mvprintw(r->y, r->x, "%-*s", r->w, lit ? label : "");
+}
 
-        // upper segment on right
-        if (digit_data[digit] & UR_VERT) {
-            move(y, x+5);
-            // draw line between two segments
-            printw(" ");
-            move(y+1, x+5);
-            printw(" ");
-            move(y+2, x+5);
-            printw(" ");
-            move(y+3, x+5);
-            printw(" ");
-        }
+static void draw_extras(void)
+{
+    panel *p = current;
+    struct layout *l = &p->layout;
+    digit bits = p->digit_data[EXTRA];
 
-        // center segment
-        if (digit_data[digit] & MID_HORIZ) {
-            move(y+3, x);
-            printw("      ");
-        }        
-        
-        // lower segment on left
-        if (digit_data[digit] & LL_VERT) {
-            move(y+3, x);
-            printw(" ");
-            move(y+4, x);
-            printw(" ");
-            move(y+5, x);
-            printw(" ");
-            move(y+6, x);
-            printw(" ");            
-        }
+    draw_dot(bits & COLON_UL, &l->dot[0]);
+    draw_dot(bits & COLON_LL, &l->dot[1]);
+    draw_dot(bits & COLON_UR, &l->dot[2]);
+    draw_dot(bits & COLON_LR, &l->dot[3]);
 
-        // lower segment on right
-        if (digit_data[digit] & LR_VERT) {
-            move(y+3, x+5);
-            printw(" ");
-            move(y+4, x+5);
-            printw(" ");
-            move(y+5, x+5);
-            printw(" ");
-            move(y+6, x+5);
-            printw(" ");            
-        }
+    draw_indicator(bits & INDICATOR_AM,   &l->indicator[0], "AM");
+    draw_indicator(bits & INDICATOR_PM,   &l->indicator[1], "PM");
+    draw_indicator(bits & INDICATOR_24,   &l->indicator[2], "24H");
+    draw_indicator(bits & INDICATOR_DATE, &l->indicator[3], "Date");
 
+    p->shown_data[EXTRA] = bits;
+}
 
-        // bottom segment
-        if (digit_data[digit] & BOT_HORIZ) {
-            move(y+6, x);
-            // draw line between two segments
-            printw(" ");
-            printw("    ");
-            // draw line between two segments
-            printw(" ");
-        }
+static void curses_display(void)
+{
+    panel *p = current;
+    int  digit;
+    int  Key;
 
-        // decimal point
-        if (digit_data[digit] & DECIMAL) {
-            move(y+6, x+7);
-            printw(" ");
-        }
-    }
+    if ( p->screen == NULL )   // never started; nothing to draw on
+        return;
+    set_term(p->screen);
 
-    /* This draws the keys.
-     */
-    attron(COLOR_PAIR(3));
-    KeyOffsetX = 5;
+    if (p->full_redraw)
+        draw_background();
 
-    // top row of fixed keys
-    KeyOffsetY = 13;
-    for (Key = 0; Key < 5; Key++) {
-        dobox(KeyOffsetY + 1,            // top
-              KeyOffsetX + Key * 14 + 2, // left
-              3, // height
-              10, // width
-              KeyStr[Key] // text
-            );        
-    }
+    if (p->full_redraw || memcmp(p->shown_title, p->title_bar, 78) != 0)
+        draw_title();
 
-    // second row of user-defined keys
-    KeyOffsetY = 17;
     for (Key = 0; Key < 5; Key++) {
-        // only draw key if any text is set
-        if (strlen(RowTwoKeys[Key]) > 0) {
-            dobox(KeyOffsetY + 1, // top
-                  KeyOffsetX + Key * 14 + 2, // left
-                  3, // height
-                  10, // width
-                  RowTwoKeys[Key] // text
-                );        
-        }
+        if (p->full_redraw || strcmp(p->shown_keys[Key], p->RowTwoKeys[Key]))
+            draw_row_two_key(Key);
     }
 
-    //  This draws the AM/PM/24H indicator
-    attron(COLOR_PAIR(2)); // red text on black background
-    if ( digit_data[EXTRA] & INDICATOR_AM ) {
-        move(5, 69);
-        printw("AM");
-    }
-    if ( digit_data[EXTRA] & INDICATOR_PM ) {
-        move(6, 69);
-        printw("PM");
-    }
-    if ( digit_data[EXTRA] & INDICATOR_24 ) {
-        move(7, 69);
-        printw("24H");
-    }
-    if ( digit_data[EXTRA] & INDICATOR_DATE ) {
-        move(8, 69);
-        printw("Date");
+    /* This draws the 6 digits.
+     */
+    for (digit = 0; digit <= 5; digit++) {
+        if (p->full_redraw || p->shown_data[digit] != p->digit_data[digit])
+            draw_digit(digit);
     }
 
+    //  This draws the colons and the AM/PM/24H indicator
+    if (p->full_redraw || p->shown_data[EXTRA] != p->digit_data[EXTRA])
+        draw_extras();
+
+    p->full_redraw = 0;
+
     move (0,0);
     refresh();
 }
 
 void set_key_text(int key, char *text)
 {
-    strncpy(RowTwoKeys[key], text, 6);
-    RowTwoKeys[key][6] = '\0';
+    strncpy(current->RowTwoKeys[key], text, 6);
+    current->RowTwoKeys[key][6] = '\0';
 }
 
 
@@ -466,27 +478,20 @@ int register_keyhandler( void(*f)(keybits) )
     return 1;
 }
 
-void get_key()
+static void curses_handle_key(int c)
 {
-    int     c;
     int     mouse_return;
     MEVENT  mouse_data;
 
-    int     KeyRow, KeyCol;
-    int     ColCheck;
-
-    keybits KeyboardBits;
+    int     KeyboardBits;
 
-    char *showbits = getenv("SHOWCLOCKLEDBITS");
-
-    // only show bits, don't do fullscreen mode
-    if ( showbits && strcmp(showbits, "YES") == 0 ) {
-        pause();
+    // curses has picked up a new size; lay it out and paint everything
+    if ( c == KEY_RESIZE ) {
+        layout_panel(&current->layout, LINES, COLS, 6);
+        current->full_redraw = 1;
+        curses_display();
         return;
-    }    
-
-    
-    c = wgetch(stdscr); // blocks until a key is hit
+    }
 
     if ( c != KEY_MOUSE ) {
         if ( c < 128 )
@@ -502,22 +507,1106 @@ void get_key()
         fprintf(stderr, "Error reading mouse.");
     }
 
-    KeyRow = -1;
+    // which key, if any: the column is in the high 4 bits, the row low
+    KeyboardBits = layout_key(&current->layout, mouse_data.y, mouse_data.x);
+    if (KeyboardBits != -1)
+        keyhandler(KeyboardBits);
+}
+
+/* Hand every key that's waiting to the keyhandler, not just the first,
+ * so a burst of keys doesn't cost one trip around the event loop each.
+ */
+static void curses_get_key(void)
+{
+    int c;
 
-    if (14 <= mouse_data.y && mouse_data.y <= 16) 
-        KeyRow = 0;
-    else if (18 <= mouse_data.y && mouse_data.y <= 20)
-        KeyRow = 1;
+    set_term(current->screen);
+    c = wgetch(stdscr); // blocks until a key is hit
 
-    if (KeyRow == -1)
-        return;
+    nodelay(stdscr, TRUE);
+    do {
+        curses_handle_key(c);
+    } while ( ( c = wgetch(stdscr) ) != ERR );
+    nodelay(stdscr, FALSE);
+}
 
-    KeyCol = (mouse_data.x - 8) / 14;
-    ColCheck = mouse_data.x - 8 - (KeyCol * 14);
-    if (ColCheck < 0 || ColCheck > 8)
-        return;
 
-    KeyboardBits =  (KeyCol << 4) + KeyRow;
+/* Start curses on another terminal for panel "p".  Each terminal gets
+ * its own SCREEN, and set_term() switches between them as we go.
+ */
+static void curses_attach(panel *p, char *tty)
+{
+    char *term = check_terminal();
+
+    if ( ( p->tty = fopen(tty, "r+") ) == NULL ) {
+        perror(tty);
+        exit(1);
+    }
+
+    p->screen = newterm(term, p->tty, p->tty);
+    if ( p->screen == NULL ) {
+        fprintf(stderr, "I can't start curses on %s.\n", tty);
+        exit(1);
+    }
+    setup_screen(p, tty);
+    p->key_fd = fileno(p->tty);
+    p->tty_name = tty;
+
+    // newterm() made it the current screen; put ours back
+    if ( current->screen )
+        set_term(current->screen);
+}
+
+
+/* Catch curses up with the terminal's new size and repaint.
+ * Called when we get SIGWINCH some other way than curses' own handler.
+ */
+static void curses_resize(void)
+{
+    panel *p = current;
+    struct winsize size;
+    int    fd = p->tty ? fileno(p->tty) : STDOUT_FILENO;
+
+    set_term(p->screen);
+    if ( ioctl(fd, TIOCGWINSZ, &size) == 0 )
+        resizeterm(size.ws_row, size.ws_col);
+    layout_panel(&p->layout, LINES, COLS, 6);
+    p->full_redraw = 1;
+    curses_display();
+}
+
+
+/* The other backends don't draw anything that could go stale, so they
+ * just note the panel as shown, for display_changed().
+ */
+static void mark_shown(panel *p)
+{
+    memcpy(p->shown_data, p->digit_data, sizeof(p->shown_data));
+    memcpy(p->shown_title, p->title_bar, sizeof(p->shown_title));
+    memcpy(p->shown_keys, p->RowTwoKeys, sizeof(p->shown_keys));
+    p->full_redraw = 0;
+}
+
+
+/* Bytes the backends have sent out, for the stats.  Curses does its
+ * own writing, where we can't count it.
+ */
+static long long bytes_written = 0;
+
+
+/* BITS BACKEND: print the raw bytes instead of drawing them */
+
+static void bits_start(void)
+{
+    bytes_written += printf("Showing bits: unset SHOWCLOCKLEDBITS "
+                            "to see LEDs.\n");
+}
+
+static void bits_display(void)
+{
+    int  digit;
+    int  n = 0;
+
+    if ( current->tty_name )
+        n += printf ("%s: ", current->tty_name);
+    for (digit = 0; digit <=5 ; digit++) {
+        n += printf ("%d : 0x%x - ", digit, current->digit_data[digit]);
+    }
+    n += printf (" 7 : 0x%x \n", current->digit_data[7]);
+    bytes_written += n;
+    mark_shown(current);
+}
+
+
+/* NULL BACKEND: keep the digit buffer, show nothing */
+
+static void null_start(void)    { }
+static void null_end(void)      { }
+static void null_display(void)  { mark_shown(current); }
+static void null_resize(void)   { }
+static void null_attach(panel *p, char *tty) { p->tty_name = tty; }
+static void null_flush(void)    { }
+
+// nothing to read keys from, so just wait for a signal
+static void no_keys(void)
+{
+    pause();
+}
+
+
+/* SHARED FRAME BUFFER: a copy of every frame, for other programs
+ *
+ * The layout is in ledshm.h.  Copying a frame in is a few memcpy()s,
+ * and readers never make us do anything else.  A panel another
+ * program has taken over is drawn from its slot instead, and we leave
+ * the slot alone.
+ */
+
+static struct ledshm *shared = NULL;
+static char          *shared_name = NULL;
+
+// 1 if process "pid" has exited
+static int process_gone(uint32_t pid)
+{
+    return kill(pid, 0) == -1 && errno == ESRCH;
+}
+
+/* Open the frame buffer "name", making it if it isn't there.  One
+ * that another running clock writes, or that isn't a frame buffer at
+ * all, is left alone; one whose clock died is ours to reuse.
+ */
+void share_display(char *name)
+{
+    struct stat info;
+    uint32_t    clock_pid;
+    int         fd;
+
+    fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if ( fd == -1 || fstat(fd, &info) == -1 ) {
+        perror(name);
+        exit(1);
+    }
+    if ( info.st_size != 0 && info.st_size != sizeof(struct ledshm) ) {
+        fprintf(stderr, "%s is not a clock's frame buffer\n", name);
+        exit(1);
+    }
+    if ( info.st_size == 0 && ftruncate(fd, sizeof(struct ledshm)) == -1 ) {
+        perror(name);
+        exit(1);
+    }
+    shared = mmap(NULL, sizeof(struct ledshm), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fd, 0);
+    if ( shared == MAP_FAILED ) {
+        perror(name);
+        exit(1);
+    }
+    close(fd);
+
+    if ( shared->magic != 0 && shared->magic != LEDSHM_MAGIC ) {
+        fprintf(stderr, "%s is not a clock's frame buffer\n", name);
+        exit(1);
+    }
 
-    keyhandler(KeyboardBits);
+    // take it from a clock that died; two of us starting at once
+    // can't both get it
+    clock_pid = atomic_load(&shared->clock);
+    if ( ( clock_pid != 0 && ! process_gone(clock_pid) )
+         || ! atomic_compare_exchange_strong(&shared->clock, &clock_pid,
+                                             getpid()) ) {
+        fprintf(stderr, "%s is in use by clock process %u\n", name,
+                clock_pid);
+        exit(1);
+    }
+
+    shared->npanels = 0;   // a dead clock's panels are handed out again
+    shared->magic = LEDSHM_MAGIC;
+    shared_name = name;
+}
+
+/* Make the slot's sequence number odd, from the even "*seq" it was;
+ * 0 if it was odd already (its owner is writing), and we don't wait.
+ */
+static int lock_slot(struct ledshm_panel *slot, uint32_t *seq)
+{
+    *seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    if ( ( *seq & 1 )
+         || ! atomic_compare_exchange_strong_explicit(&slot->seq, seq,
+                                                      *seq + 1,
+                                                      memory_order_acquire,
+                                                      memory_order_relaxed) )
+        return 0;
+    atomic_thread_fence(memory_order_release);
+    return 1;
+}
+
+// the process drawing on this slot instead of us; 0 if there isn't one
+static pid_t slot_owner(struct ledshm_panel *slot)
+{
+    uint32_t owner = atomic_load_explicit(&slot->owner, memory_order_acquire);
+
+    // one that died without giving the panel back has lost it
+    if ( owner != 0 && process_gone(owner) ) {
+        atomic_compare_exchange_strong(&slot->owner, &owner, 0);
+        return 0;
+    }
+    return owner;
+}
+
+// copy the current panel's frame out, inside its sequence number
+static void publish(panel *p)
+{
+    struct ledshm_panel *slot = p->shared;
+    uint32_t             seq;
+
+    if ( slot == NULL ) {
+        if ( shared->npanels == LEDSHM_PANELS )
+            return;   // no room; this one isn't shared
+        slot = p->shared = &shared->panel[shared->npanels];
+        strncpy(slot->name, p->tty_name ? p->tty_name : "",
+                sizeof(slot->name) - 1);
+        shared->npanels++;
+    }
+
+    // while the owner is taking the panel over, this frame isn't shared
+    if ( ! lock_slot(slot, &seq) )
+        return;
+    if ( atomic_load_explicit(&slot->owner, memory_order_relaxed) == 0 ) {
+        memcpy(slot->digits, p->digit_data, sizeof(slot->digits));
+        memcpy(slot->title, p->title_bar, sizeof(slot->title));
+        memcpy(slot->keys, p->RowTwoKeys, sizeof(slot->keys));
+        slot->frames++;
+    }
+
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    atomic_fetch_add_explicit(&shared->generation, 1, memory_order_release);
+}
+
+/* STREAM BACKEND: fixed-size binary records, for programs to read
+ *
+ * Every frame is one 16-byte record, all numbers little-endian:
+ *
+ *      bytes 0-3   seconds since 1970 (low 32 bits) when it was drawn
+ *      bytes 4-5   milliseconds
+ *      byte  6     panel: 0 for our own, then in the order opened
+ *                  (so there are at most MAX_PANELS)
+ *      byte  7     which of the 8 digit bytes changed since this
+ *                  panel's last record (bit n is digit n); 0xff first
+ *      bytes 8-15  the 8 digit bytes, as in LED-layout.txt
+ *
+ * Records go to stdout, or the file named in $CLOCKLEDSTREAM, and are
+ * saved up and written together when a frame is done (flush_display())
+ * or the buffer fills.  ledstream.c turns them back into text.
+ */
+
+#define STREAM_RECORD 16
+#define MAX_PANELS    256
+
+static unsigned char stream_buffer[256 * STREAM_RECORD];
+static int           stream_used = 0;
+static int           stream_fd = -1;
+
+static void stream_flush(void)
+{
+    unsigned char *p = stream_buffer;
+    ssize_t        n;
+
+    while ( stream_used > 0 ) {
+        if ( ( n = write(stream_fd, p, stream_used) ) == -1 ) {
+            perror("Could not write frames");
+            exit(1);
+        }
+        bytes_written += n;
+        p += n;
+        stream_used -= n;
+    }
+}
+
+// open the output; panels on other "terminals" can get here first
+static void stream_start(void)
+{
+    char *file = getenv("CLOCKLEDSTREAM");
+
+    if ( stream_fd != -1 )
+        return;
+    if ( file == NULL ) {
+        stream_fd = STDOUT_FILENO;
+        return;
+    }
+    stream_fd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if ( stream_fd == -1 ) {
+        perror(file);
+        exit(1);
+    }
+}
+
+static void stream_end(void)
+{
+    stream_flush();
+}
+
+static void stream_display(void)
+{
+    panel          *p = current;
+    unsigned char  *r;
+    struct timespec now;
+    unsigned int    changed = 0;
+    int             i;
+
+    stream_start();
+    if ( stream_used == sizeof(stream_buffer) )
+        stream_flush();
+    r = stream_buffer + stream_used;
+    stream_used += STREAM_RECORD;
+
+    for (i = 0; i < 8; i++) {
+        if ( p->full_redraw || p->shown_data[i] != p->digit_data[i] )
+            changed |= 1 << i;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    r[0] = now.tv_sec;
+    r[1] = now.tv_sec >> 8;
+    r[2] = now.tv_sec >> 16;
+    r[3] = now.tv_sec >> 24;
+    r[4] = (now.tv_nsec / 1000000);
+    r[5] = (now.tv_nsec / 1000000) >> 8;
+    r[6] = p->number;
+    r[7] = changed;
+    memcpy(r + 8, p->digit_data, 8);
+
+    mark_shown(p);
+}
+
+
+/* ANSI BACKEND: the curses panel, drawn with our own escape sequences
+ *
+ * Everything that never changes (the background, the frame and the
+ * fixed keys) is turned into escapes once per terminal size, and which
+ * cells of each row of a digit are lit is worked out once per digit
+ * size.  A frame is then a memcpy() and a few short runs of cells into
+ * one buffer and a single write() per panel, instead of a curses call
+ * for every cell, and after the first one only the cells that change
+ * are sent.
+ *
+ * It assumes an ANSI (VT100 or later) terminal with colour and the
+ * xterm mouse modes, so it never looks at terminfo.  Mouse clicks
+ * come in the SGR encoding, "ESC [ < button ; x ; y M".
+ */
+
+#define ANSI_LIT    "\033[30;41m"   // black on red: a lit segment
+#define ANSI_DARK   "\033[31;40m"   // red on black: the LED area
+#define ANSI_KEYS   "\033[33;44m"   // yellow on blue: the keys
+#define ANSI_LINES  "\033(0"        // DEC line drawing: q is -, x is |
+#define ANSI_TEXT   "\033(B"
+
+#define ANSI_START  "\033[?1049h\033[?25l\033[?1000h\033[?1006h" \
+                    "\033[0m\033[2J"
+#define ANSI_STOP   "\033[?1006l\033[?1000l\033[0m\033[2J\033[?25h" \
+                    "\033[?1049l"
+
+// the most a cell can take: a colour, a switch of character set, itself
+#define ANSI_CELL   ( sizeof(ANSI_LIT) + sizeof(ANSI_LINES) + 1 )
+
+enum { LIT = 1, DARK, KEYS };   // the curses colour pairs
+
+static const char *ansi_colour[] = { "", ANSI_LIT, ANSI_DARK, ANSI_KEYS };
+
+/* The screen as it should look, for the parts that are worked out
+ * by painting them here and then turning a region into escapes.  It's
+ * as big as the panel being drawn, and only ever holds what's about
+ * to be sent, so panels of different sizes can share it.
+ */
+static struct cell {
+    char ch;
+    char colour;
+    char line;      // ch is a DEC line drawing character
+} *ansi_grid;
+static int grid_cols, grid_cells;
+
+#define GRID(y, x)  ansi_grid[(y) * grid_cols + (x)]
+
+static void grid_size(int rows, int cols)
+{
+    if ( rows * cols > grid_cells ) {
+        free(ansi_grid);
+        if ( ( ansi_grid = malloc(rows * cols * sizeof(*ansi_grid)) ) == NULL ) {
+            perror("Could not lay out the panel");
+            exit(1);
+        }
+        grid_cells = rows * cols;
+    }
+    grid_cols = cols;
+}
+
+static void grid_fill(int top, int left, int height, int width, int colour)
+{
+    int y, x;
+
+    for (y = top; y < top + height; y++) {
+        for (x = left; x < left + width; x++) {
+            GRID(y, x).ch = ' ';
+            GRID(y, x).colour = colour;
+            GRID(y, x).line = 0;
+        }
+    }
+}
+
+static void grid_line(int y, int x, char ch)
+{
+    GRID(y, x).ch = ch;
+    GRID(y, x).line = 1;
+}
+
+static void grid_text(int y, int x, char *text)
+{
+    for ( ; *text && x < grid_cols; text++, x++) {
+        GRID(y, x).ch = *text;
+        GRID(y, x).line = 0;
+    }
+}
+
+// like dobox(), in the key colours
+static void grid_box(struct rect *r, char *text)
+{
+    int top = r->y, left = r->x, height = r->h, width = r->w;
+    int i;
+
+    grid_fill(top, left, height, width, KEYS);
+    for (i = 1; i < width - 1; i++) {
+        grid_line(top, left + i, 'q');
+        grid_line(top + height - 1, left + i, 'q');
+    }
+    for (i = 1; i < height - 1; i++) {
+        grid_line(top + i, left, 'x');
+        grid_line(top + i, left + width - 1, 'x');
+    }
+    grid_line(top, left, 'l');
+    grid_line(top, left + width - 1, 'k');
+    grid_line(top + height - 1, left, 'm');
+    grid_line(top + height - 1, left + width - 1, 'j');
+    grid_text(top + height / 2, left + 2, text);
+}
+
+// the escapes that draw a region of the grid; returns the new end
+static char *grid_region(char *out, int top, int left, int height, int width)
+{
+    int colour, line, y, x;
+
+    for (y = top; y < top + height; y++) {
+        out += sprintf(out, "\033[%d;%dH", y + 1, left + 1);
+        colour = -1;
+        line = 0;
+        for (x = left; x < left + width; x++) {
+            struct cell *c = &GRID(y, x);
+
+            if ( c->colour != colour ) {
+                out = stpcpy(out, ansi_colour[(int) c->colour]);
+                colour = c->colour;
+            }
+            if ( c->line != line ) {
+                out = stpcpy(out, c->line ? ANSI_LINES : ANSI_TEXT);
+                line = c->line;
+            }
+            *out++ = c->ch;
+        }
+        if ( line )
+            out = stpcpy(out, ANSI_TEXT);
+    }
+    return out;
+}
+
+/* For each digit size, bit x of digit_mask[scale][bits * h + r] is
+ * whether column x of row r of a digit showing "bits" is lit; a digit
+ * is at most 64 columns wide.  Worked out the first time a panel is
+ * that size.
+ */
+static uint64_t *digit_mask[LAYOUT_MAX_SCALE + 1];
+
+static char *ansi_frame;           // the frame being put together
+static int   ansi_frame_size;
+static int   pen = -1;             // the colour the terminal has now
+
+// switch to "colour" unless that's what we're already drawing in
+static char *set_pen(char *out, int colour)
+{
+    if ( colour != pen ) {
+        out = stpcpy(out, ansi_colour[colour]);
+        pen = colour;
+    }
+    return out;
+}
+
+// the lit cells of every row of every pattern, from the segments of digit 0
+static void make_digit_masks(struct layout *l)
+{
+    struct rect *cell = &l->digit[0];
+    uint64_t    *mask;
+    int          bits, segment, y, x;
+
+    if ( digit_mask[l->scale] )
+        return;
+    mask = calloc(256 * cell->h, sizeof(*mask));
+    if ( mask == NULL ) {
+        perror("Could not lay out the panel");
+        exit(1);
+    }
+
+    for (bits = 0; bits < 256; bits++) {
+        for (segment = 0; segment < 8; segment++) {
+            struct rect *s = &l->segment[0][segment];
+
+            if ( ! ( bits & (1 << segment) ) )
+                continue;
+            for (y = s->y - cell->y; y < s->y - cell->y + s->h; y++) {
+                for (x = s->x - cell->x; x < s->x - cell->x + s->w; x++)
+                    mask[bits * cell->h + y] |= (uint64_t) 1 << x;
+            }
+        }
+    }
+    digit_mask[l->scale] = mask;
+}
+
+/* Lay panel "p" out for the size its terminal is now, and turn the
+ * background, frame and fixed keys into escapes, as draw_background()
+ * would draw them.
+ */
+static void ansi_layout(panel *p)
+{
+    struct layout *l = &p->layout;
+    struct winsize size;
+    int            i, need;
+
+    if ( ioctl(p->out_fd, TIOCGWINSZ, &size) == 0 )
+        layout_panel(l, size.ws_row, size.ws_col, 6);
+    else
+        layout_panel(l, 24, 80, 6);
+    make_digit_masks(l);
+    grid_size(l->rows, l->cols);
+
+    grid_fill(0, 0, l->divider, l->cols, DARK);
+    grid_fill(l->divider, 0, l->bottom - l->divider + 1, l->cols, KEYS);
+    for (i = 0; i < l->bottom; i++) {
+        grid_fill(i, 0, 1, 3, KEYS);
+        grid_line(i, 1, 'x');
+        grid_fill(i, l->cols - 3, 1, 3, KEYS);
+        grid_line(i, l->cols - 2, 'x');
+    }
+    for (i = 1; i < l->cols - 1; i++) {
+        grid_line(l->divider, i, 'q');
+        grid_line(l->bottom, i, 'q');
+    }
+    grid_line(l->divider, 1, 't');
+    grid_line(l->divider, l->cols - 2, 'u');
+    grid_line(l->bottom, 1, 'm');
+    grid_line(l->bottom, l->cols - 2, 'j');
+    for (i = 0; i < 5; i++)
+        grid_box(&l->key[0][i], KeyStr[i]);
+
+    // a whole frame is never more than every cell at its dearest
+    need = ( l->bottom + 1 ) * ( l->cols * ANSI_CELL + 16 );
+    if ( need * 2 > ansi_frame_size ) {
+        free(ansi_frame);
+        ansi_frame_size = need * 2;
+        if ( ( ansi_frame = malloc(ansi_frame_size) ) == NULL ) {
+            perror("Could not lay out the panel");
+            exit(1);
+        }
+    }
+    free(p->background);
+    if ( ( p->background = malloc(need) ) == NULL ) {
+        perror("Could not lay out the panel");
+        exit(1);
+    }
+    p->background_len = grid_region(p->background, 0, 0, l->bottom + 1,
+                                    l->cols) - p->background;
+}
+
+/* Columns "first" to "last" of row r of digit d, now showing "now". */
+static char *digit_cells(char *out, panel *p, int d, int r, uint64_t now,
+                         int first, int last)
+{
+    struct rect *cell = &p->layout.digit[d];
+    int          x;
+
+    out += sprintf(out, "\033[%d;%dH", cell->y + r + 1, cell->x + first + 1);
+    for (x = first; x <= last; x++) {
+        out = set_pen(out, ( ( now >> x ) & 1 ) ? LIT : DARK);
+        *out++ = ' ';
+    }
+    return out;
+}
+
+/* Row r of digit d, going from "was" to "now": just the cells that
+ * change, usually a segment or two, or all of it if it's being redrawn.
+ */
+static char *digit_row(char *out, panel *p, int d, int r, digit was,
+                       digit now)
+{
+    struct layout *l = &p->layout;
+    uint64_t      *mask = digit_mask[l->scale];
+    uint64_t       changed;
+    int            h = l->digit[d].h, first = 0, last = l->digit[d].w - 1;
+
+    if ( p->full_redraw )
+        return digit_cells(out, p, d, r, mask[now * h + r], first, last);
+
+    changed = mask[was * h + r] ^ mask[now * h + r];
+    if ( changed == 0 )
+        return out;
+    while ( ! ( changed & ( (uint64_t) 1 << first ) ) )
+        first++;
+    while ( ! ( changed & ( (uint64_t) 1 << last ) ) )
+        last--;
+    return digit_cells(out, p, d, r, mask[now * h + r], first, last);
+}
+
+// a colon dot, lit or dark
+static char *dot_cells(char *out, struct rect *dot, int lit)
+{
+    int y, x;
+
+    out = set_pen(out, lit ? LIT : DARK);
+    for (y = dot->y; y < dot->y + dot->h; y++) {
+        out += sprintf(out, "\033[%d;%dH", y + 1, dot->x + 1);
+        for (x = 0; x < dot->w; x++)
+            *out++ = ' ';
+    }
+    return out;
+}
+
+// write all of "len" bytes, or give up on this terminal's frame
+static void write_all(int fd, char *buffer, int len)
+{
+    ssize_t n;
+
+    while ( len > 0 ) {
+        if ( ( n = write(fd, buffer, len) ) == -1 )
+            return;
+        bytes_written += n;
+        buffer += n;
+        len -= n;
+    }
+}
+
+/* Put terminal "fd" in the modes we need: no echo, a key at a time
+ * (but ^C still interrupts), mouse clicks reported, and the screen to
+ * ourselves.  "where" is for error messages.
+ */
+static void ansi_setup(panel *p, char *where)
+{
+    struct termios raw;
+    struct winsize size;
+
+    if ( tcgetattr(p->key_fd, &p->saved_tty) == -1 ) {
+        perror(where);
+        exit(1);
+    }
+    if ( ioctl(p->out_fd, TIOCGWINSZ, &size) == 0
+         && ( size.ws_row < 24 || size.ws_col < 80 ) ) {
+        fprintf(stderr, "Your window %s is %dx%d; must be at least 80x24.\n",
+                where, size.ws_col, size.ws_row);
+        exit(1);
+    }
+
+    raw = p->saved_tty;
+    raw.c_lflag &= ~( ICANON | ECHO );
+    raw.c_iflag &= ~( ICRNL | IXON );
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if ( tcsetattr(p->key_fd, TCSANOW, &raw) == -1 ) {
+        perror(where);
+        exit(1);
+    }
+
+    ansi_layout(p);
+    write_all(p->out_fd, ANSI_START, strlen(ANSI_START));
+    p->ansi_ready = 1;
+    p->full_redraw = 1;
+}
+
+static void ansi_display(void);
+
+static void ansi_start(void)
+{
+    ansi_setup(&main_panel, "(standard input)");
+    ansi_display();
+}
+
+static void ansi_end(void)
+{
+    panel *p;
+
+    for (p = panels; p != NULL; p = p->next) {
+        if ( ! p->ansi_ready )
+            continue;
+        write_all(p->out_fd, ANSI_STOP, strlen(ANSI_STOP));
+        tcsetattr(p->key_fd, TCSANOW, &p->saved_tty);
+        p->ansi_ready = 0;
+    }
+}
+
+static void ansi_attach(panel *p, char *tty)
+{
+    if ( ( p->key_fd = open(tty, O_RDWR | O_NOCTTY | O_CLOEXEC) ) == -1 ) {
+        perror(tty);
+        exit(1);
+    }
+    p->out_fd = p->key_fd;
+    p->tty_name = tty;
+    ansi_setup(p, tty);
+}
+
+static void ansi_display(void)
+{
+    static char *labels[] = { "AM", "PM", "24H", "Date" };
+    static const int colon_bits[] = { 0x80, 0x40, 0x20, 0x10 };  // as dot[]
+    panel         *p = current;
+    struct layout *l = &p->layout;
+    char          *out = ansi_frame;
+    int            d, r, i, key, changed, left;
+    digit          bits;
+
+    if ( ! p->ansi_ready )     // never started; nothing to draw on
+        return;
+    pen = -1;
+    grid_size(l->rows, l->cols);
+
+    if ( p->full_redraw ) {
+        memcpy(out, p->background, p->background_len);
+        out += p->background_len;
+    }
+
+    // the title bar, as draw_title() does it
+    if ( p->full_redraw || memcmp(p->shown_title, p->title_bar, 78) != 0 ) {
+        left = ( l->cols - 80 ) / 2 + 1;
+        grid_fill(0, 0, 1, l->cols, KEYS);
+        for (i = 1; i < l->cols - 1; i++)
+            grid_line(0, i, 'q');
+        for (i = 0; i < 78; i++) {
+            if ( p->title_bar[i] == '-' || p->title_bar[i] == '\0' )
+                grid_line(0, left + i, 'q');
+            else {
+                GRID(0, left + i).ch = p->title_bar[i];
+                GRID(0, left + i).line = 0;
+            }
+        }
+        grid_line(0, 1, 'l');
+        grid_line(0, l->cols - 2, 'k');
+        out = grid_region(out, 0, 0, 1, l->cols);
+        pen = -1;
+        memcpy(p->shown_title, p->title_bar, sizeof(p->shown_title));
+    }
+
+    for (key = 0; key < 5; key++) {
+        struct rect *k = &l->key[1][key];
+
+        if ( ! p->full_redraw
+             && strcmp(p->shown_keys[key], p->RowTwoKeys[key]) == 0 )
+            continue;
+        if ( p->RowTwoKeys[key][0] )
+            grid_box(k, p->RowTwoKeys[key]);
+        else
+            grid_fill(k->y, k->x, k->h, k->w, KEYS);
+        out = grid_region(out, k->y, k->x, k->h, k->w);
+        pen = -1;
+        memcpy(p->shown_keys[key], p->RowTwoKeys[key],
+               sizeof(p->shown_keys[0]));
+    }
+
+    for (d = 0; d < l->ndigits; d++) {
+        bits = p->digit_data[d];
+        if ( ! p->full_redraw && p->shown_data[d] == bits )
+            continue;
+        for (r = 0; r < l->digit[d].h; r++)
+            out = digit_row(out, p, d, r, p->shown_data[d], bits);
+        p->shown_data[d] = bits;
+    }
+
+    // the colons and indicators that changed
+    bits = p->digit_data[EXTRA];
+    changed = p->full_redraw ? 0xff : ( bits ^ p->shown_data[EXTRA] );
+    for (i = 0; i < 4; i++) {
+        if ( changed & colon_bits[i] )
+            out = dot_cells(out, &l->dot[i], bits & colon_bits[i]);
+        if ( changed & ( 1 << i ) ) {
+            out = set_pen(out, DARK);
+            out += sprintf(out, "\033[%d;%dH%-*s", l->indicator[i].y + 1,
+                           l->indicator[i].x + 1, l->indicator[i].w,
+                           ( ( bits >> i ) & 1 ) ? labels[i] : "");
+        }
+    }
+    p->shown_data[EXTRA] = bits;
+
+    p->full_redraw = 0;
+    if ( out > ansi_frame )
+        write_all(p->out_fd, ansi_frame, out - ansi_frame);
+}
+
+/* Handle the key or escape sequence at "s"; returns how many of the
+ * "n" bytes it used, or 0 if the sequence isn't all there yet.
+ */
+static int ansi_key(unsigned char *s, int n)
+{
+    int button, x, y, len, key;
+
+    if ( s[0] != '\033' ) {
+        keyhandler((keybits) ( s[0] & 0x7f ) << 8);
+        return 1;
+    }
+    if ( n < 2 )
+        return 0;
+    if ( s[1] != '[' )
+        return 1;   // ESC on its own, or with alt; ignore it
+
+    for (len = 2; len < n; len++) {
+        if ( s[len] >= 0x40 && s[len] <= 0x7e )
+            break;
+    }
+    if ( len == n )
+        return ( n < sizeof(current->input) ) ? 0 : n;   // junk; drop it
+
+    // ESC [ < button ; x ; y M is a press; "m" would be the release
+    if ( s[2] == '<' && s[len] == 'M'
+         && sscanf((char *) s + 3, "%d;%d;%d", &button, &x, &y) == 3
+         && button == 0
+         && ( key = layout_key(&current->layout, y - 1, x - 1) ) != -1 )
+        keyhandler(key);
+    return len + 1;
+}
+
+static void ansi_get_key(void)
+{
+    panel  *p = current;
+    ssize_t got;
+    int     used = 0, n;
+
+    got = read(p->key_fd, p->input + p->input_len,
+               sizeof(p->input) - p->input_len);
+    if ( got <= 0 )
+        return;
+    p->input_len += got;
+
+    while ( used < p->input_len
+            && ( n = ansi_key(p->input + used, p->input_len - used) ) > 0 )
+        used += n;
+    memmove(p->input, p->input + used, p->input_len - used);
+    p->input_len -= used;
+}
+
+static void ansi_resize(void)
+{
+    if ( ! current->ansi_ready )
+        return;
+    ansi_layout(current);
+    current->full_redraw = 1;
+    ansi_display();
+}
+
+
+/* A backend is the set of things that differ between output targets.
+ * start_display() picks one, and the functions below call through it,
+ * so nothing on the tick path looks at the environment again.
+ */
+struct display_backend {
+    char  *name;
+    int    has_keys;   // does get_key() have anything to read?
+    void (*start)(void);
+    void (*end)(void);
+    void (*display)(void);
+    void (*get_key)(void);
+    void (*resize)(void);
+    void (*attach)(panel *, char *);   // set up a panel on another tty
+    void (*flush)(void);               // the frame is done; send it
+    int    counted;    // do its bytes go through bytes_written?
+};
+
+static const struct display_backend backends[] = {
+    { "curses", 1, curses_start, curses_end,
+                   curses_display, curses_get_key, curses_resize,
+                   curses_attach, null_flush,   0 },
+    { "bits",   0, bits_start,   null_end,
+                   bits_display,   no_keys,        null_resize,
+                   null_attach,   null_flush,   1 },
+    { "null",   0, null_start,   null_end,
+                   null_display,   no_keys,        null_resize,
+                   null_attach,   null_flush,   1 },
+    { "stream", 0, stream_start, stream_end,
+                   stream_display, no_keys,        null_resize,
+                   null_attach,   stream_flush, 1 },
+    { "ansi",   1, ansi_start,   ansi_end,
+                   ansi_display,   ansi_get_key,   ansi_resize,
+                   ansi_attach,   null_flush,   1 },
+};
+
+// until start_display() or open_panel() picks one, draw nothing
+static const struct display_backend *backend = &backends[2];
+static int backend_chosen = 0;
+
+/* The backend comes from CLOCKLEDBACKEND ("curses", "bits", "null",
+ * "stream" or "ansi").
+ * SHOWCLOCKLEDBITS=YES still works and means "bits".
+ */
+static const struct display_backend *choose_backend(void)
+{
+    char *name = getenv("CLOCKLEDBACKEND");
+    char *showbits = getenv("SHOWCLOCKLEDBITS");
+    int   i;
+
+    if ( showbits && strcmp(showbits, "YES") == 0 )
+        name = "bits";
+    if ( name == NULL )
+        name = "curses";
+
+    for (i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if ( strcmp(name, backends[i].name) == 0 )
+            return &backends[i];
+    }
+
+    fprintf(stderr, "Unknown display backend \"%s\".\n", name);
+    exit(1);
+}
+
+void start_display(void)
+{
+    if ( ! backend_chosen ) {
+        backend = choose_backend();
+        backend_chosen = 1;
+    }
+
+    memset(main_panel.digit_data, 0, sizeof(main_panel.digit_data));
+    select_panel(&main_panel);
+    backend->start();
+}
+
+void end_display(void)
+{
+    backend->end();
+    if ( shared_name )
+        shm_unlink(shared_name);
+}
+
+/* If another program owns the panel's slot, draw its latest frame
+ * in place of ours and return 1.  Ours is put back afterwards, so
+ * it's all there when the panel is given back.
+ */
+static int draw_owned(panel *p)
+{
+    struct ledshm_panel *slot = p->shared;
+    digit                digits[8];
+    char                 title[81];
+    char                 keys[5][7];
+    uint32_t             before, after;
+    int                  key;
+
+    if ( slot == NULL || slot_owner(slot) == 0 )
+        return 0;
+
+    memcpy(digits, p->digit_data, sizeof(digits));
+    memcpy(title, p->title_bar, sizeof(title));
+    memcpy(keys, p->RowTwoKeys, sizeof(keys));
+
+    do {
+        before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        memcpy(p->digit_data, slot->digits, sizeof(p->digit_data));
+        memcpy(p->title_bar, slot->title, sizeof(p->title_bar));
+        memcpy(p->RowTwoKeys, slot->keys, sizeof(p->RowTwoKeys));
+        p->outside_frames = slot->frames;
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    } while ( ( before & 1 ) || before != after );
+    p->title_bar[80] = '\0';
+    for (key = 0; key < 5; key++)
+        p->RowTwoKeys[key][6] = '\0';
+
+    backend->display();
+
+    memcpy(p->digit_data, digits, sizeof(digits));
+    memcpy(p->title_bar, title, sizeof(title));
+    memcpy(p->RowTwoKeys, keys, sizeof(keys));
+    return 1;
+}
+
+void display(void)
+{
+    if ( shared && draw_owned(current) )
+        return;
+    backend->display();
+    if ( shared )
+        publish(current);
+}
+
+void flush_display(void)
+{
+    backend->flush();
+}
+
+long long display_bytes(void)
+{
+    return backend->counted ? bytes_written : -1;
+}
+
+/* Would display() change anything on the current panel?  If not,
+ * there's no need to call it.
+ */
+int display_changed(void)
+{
+    panel *p = current;
+    int    key;
+
+    if ( p->full_redraw )
+        return 1;
+    // another program's panel changes when it sends a frame
+    if ( p->shared && slot_owner(p->shared) != 0 )
+        return p->shared->frames != p->outside_frames;
+    if ( memcmp(p->shown_data, p->digit_data, 6) != 0
+         || p->shown_data[EXTRA] != p->digit_data[EXTRA] )
+        return 1;
+    if ( memcmp(p->shown_title, p->title_bar, 78) != 0 )
+        return 1;
+    for (key = 0; key < 5; key++) {
+        if ( strcmp(p->shown_keys[key], p->RowTwoKeys[key]) != 0 )
+            return 1;
+    }
+    return 0;
+}
+
+void get_key(void)
+{
+    backend->get_key();
+}
+
+int get_key_fd(void)
+{
+    return backend->has_keys ? current->key_fd : -1;
+}
+
+void resize_display(void)
+{
+    backend->resize();
+}
+
+/* Start another panel on the terminal "tty" (a pty or serial line),
+ * blank and with the current title.  It doesn't become the current
+ * panel; use select_panel() for that.
+ */
+panel *open_panel(char *tty)
+{
+    static int opened = 0;
+    panel     *p;
+
+    if ( ! backend_chosen ) {
+        backend = choose_backend();
+        backend_chosen = 1;
+    }
+
+    if ( opened == MAX_PANELS - 1 ) {   // ours is one of them
+        fprintf(stderr, "Too many panels: at most %d\n", MAX_PANELS);
+        exit(1);
+    }
+    if ( ( p = calloc(1, sizeof(*p)) ) == NULL ) {
+        perror("Could not make a new panel");
+        exit(1);
+    }
+    p->full_redraw = 1;
+    p->key_fd = -1;
+    p->number = ++opened;
+    memcpy(p->title_bar, current->title_bar, sizeof(p->title_bar));
+
+    backend->attach(p, tty);
+
+    p->next = panels;
+    panels = p;
+
+    return p;
+}
+
+// later calls work on panel "p"; NULL means the one on our terminal
+void select_panel(panel *p)
+{
+    current = p ? p : &main_panel;
+}
+
+panel *current_panel(void)
+{
+    return current;
 }
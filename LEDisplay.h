@@ -14,8 +14,20 @@
 
 typedef unsigned char digit;
 
+/* The driver can run several panels, each on its own terminal.
+ * Everything below works on the current panel.
+ */
+typedef struct panel panel;
+
+panel *open_panel(char *tty);   // another panel, on terminal "tty"
+void   select_panel(panel *);   // NULL is the one on our own terminal
+panel *current_panel(void);
+
 digit *get_display_location(void);
 
+// $CLOCKLEDBACKEND picks the output: "curses" (default), "bits", "null",
+// "stream" for binary records, or "ansi" to draw the curses panel with
+// our own escape sequences (see LEDisplay.c)
 void start_display(void);
 void end_display(void);
 
@@ -23,8 +35,28 @@ void set_title_bar(char *);
 
 void display(void);
 
+// every panel has been drawn for this frame; send anything saved up
+void flush_display(void);
+
+// bytes sent to the terminals (or the stream) so far; -1 with curses,
+// which writes them itself
+long long display_bytes(void);
+
+// 0 if display() would leave the panel as it is
+int  display_changed(void);
+
+// also copy every frame to POSIX shared memory "name"; see ledshm.h
+void share_display(char *name);
+
 
 void get_key(void);
+
+// descriptor to watch before calling get_key(), or -1 if no keys
+int  get_key_fd(void);
+
+// the terminal changed size (SIGWINCH); repaint to fit
+void resize_display(void);
+
 typedef unsigned short int keybits;
 
 int register_keyhandler( void(*f)(keybits) );
@@ -0,0 +1,330 @@
+/* alarms.c -- alarms, one-shot and recurring
+ *
+ * Alarms come from a file (-A), one per line:
+ *
+ *      # shift bells, Monday to Friday
+ *      0 7,15,23 * * 1-5   Shift change
+ *      30 12 * * *         Lunch
+ *      @ 2026-12-24 17:00  Office closes
+ *
+ * A recurring alarm is a crontab(5) schedule: minute, hour, day of
+ * the month, month and day of the week.  Each is "*", a number or a
+ * range "a-b", maybe followed by "/step", or a list of those with
+ * commas.  A one-shot alarm is "@" and a date and time.  Anything
+ * after the schedule is the alarm's label.
+ *
+ * Times are the host's local time (from TZ), whatever offset (-o) or
+ * zone (-z) the faces show, and an alarm goes off on every face at
+ * once.
+ *
+ * The alarms are kept in a heap ordered by when each goes off next,
+ * so checking on every tick is one comparison with the top, and
+ * putting a recurring alarm back for next time is O(log n).
+ */
+
+#include "clock.h"
+
+#include <ctype.h>
+
+struct alarm {
+    time_t             when;       // next time it goes off
+    int                recurring;
+    unsigned long long minutes;    // one bit per allowed value
+    unsigned long      hours, mdays, months, wdays;
+    int                any_mday, any_wday;
+    char              *label;
+};
+
+static struct alarm **heap = NULL;
+static int            nalarms = 0;
+static int            heap_size = 0;
+
+
+/* THE HEAP: heap[0] goes off first; heap[i] is never later than
+ * heap[2i+1] or heap[2i+2].
+ */
+static void swap(int i, int j)
+{
+    struct alarm *a = heap[i];
+
+    heap[i] = heap[j];
+    heap[j] = a;
+}
+
+static void push(struct alarm *a)
+{
+    int i;
+
+    if ( nalarms == heap_size ) {
+        heap_size = heap_size ? heap_size * 2 : 64;
+        heap = realloc(heap, heap_size * sizeof(*heap));
+        if ( heap == NULL ) {
+            perror("Could not add alarm");
+            exit(1);
+        }
+    }
+
+    i = nalarms++;
+    heap[i] = a;
+    while ( i > 0 && heap[(i - 1) / 2]->when > heap[i]->when ) {
+        swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static struct alarm *pop(void)
+{
+    struct alarm *top = heap[0];
+    int           i = 0, child;
+
+    heap[0] = heap[--nalarms];
+    while ( ( child = 2 * i + 1 ) < nalarms ) {
+        if ( child + 1 < nalarms && heap[child + 1]->when < heap[child]->when )
+            child++;
+        if ( heap[i]->when <= heap[child]->when )
+            break;
+        swap(i, child);
+        i = child;
+    }
+    return top;
+}
+
+
+/* SCHEDULES */
+
+/* One crontab field, from "lo" to "hi", into bits; NULL if it's bad.
+ * "*" also sets *any, since an unrestricted day field is special.
+ */
+static char *parse_field(char *s, int lo, int hi,
+                         unsigned long long *bits, int *any)
+{
+    long from, to, step, v;
+
+    while ( *s == ' ' || *s == '\t' )
+        s++;
+
+    *bits = 0;
+    if ( any )
+        *any = ( *s == '*' && ( s[1] == ' ' || s[1] == '\t' ) );
+
+    do {
+        if ( *s == '*' ) {
+            from = lo;
+            to = hi;
+            s++;
+        } else if ( isdigit((unsigned char) *s) ) {
+            from = to = strtol(s, &s, 10);
+            if ( *s == '-' ) {
+                if ( ! isdigit((unsigned char) s[1]) )
+                    return NULL;
+                to = strtol(s + 1, &s, 10);
+            }
+        } else {
+            return NULL;
+        }
+
+        step = 1;
+        if ( *s == '/' ) {
+            if ( ! isdigit((unsigned char) s[1]) )
+                return NULL;
+            step = strtol(s + 1, &s, 10);
+        }
+        if ( from < lo || to > hi || from > to || step < 1 )
+            return NULL;
+
+        for (v = from; v <= to; v += step)
+            *bits |= 1ULL << v;
+    } while ( *s++ == ',' );
+
+    return ( s[-1] == ' ' || s[-1] == '\t' ) ? s : NULL;
+}
+
+static int day_matches(struct alarm *a, struct tm *tm)
+{
+    int mday = ( a->mdays >> tm->tm_mday ) & 1;
+    int wday = ( a->wdays >> tm->tm_wday ) & 1;
+
+    // like cron: if both are restricted, either one will do
+    if ( a->any_mday )
+        return wday;
+    if ( a->any_wday )
+        return mday;
+    return mday || wday;
+}
+
+/* The first minute after "after" that the schedule allows, or 0 if
+ * there isn't one in the next few years (say, "30 2 31 2 *").
+ */
+static time_t next_time(struct alarm *a, time_t after)
+{
+    struct tm tm;
+    time_t    t = after - after % 60 + 60;
+    time_t    next;
+    int       tries;
+
+    for (tries = 0; tries < 100000; tries++) {
+        localtime_r(&t, &tm);
+        tm.tm_sec = 0;
+        tm.tm_isdst = -1;
+
+        if ( ! ( ( a->months >> (tm.tm_mon + 1) ) & 1 ) ) {
+            tm.tm_mon++;                  // first thing next month
+            tm.tm_mday = 1;
+            tm.tm_hour = tm.tm_min = 0;
+        } else if ( ! day_matches(a, &tm) ) {
+            tm.tm_mday++;                 // first thing tomorrow
+            tm.tm_hour = tm.tm_min = 0;
+        } else if ( ! ( ( a->hours >> tm.tm_hour ) & 1 ) ) {
+            tm.tm_hour++;                 // the top of the next hour
+            tm.tm_min = 0;
+        } else if ( ! ( ( a->minutes >> tm.tm_min ) & 1 ) ) {
+            tm.tm_min++;
+        } else {
+            return t;
+        }
+
+        // an hour that happens twice can send mktime() back; don't loop
+        next = mktime(&tm);
+        t = ( next > t ) ? next : t + 60;
+    }
+    return 0;
+}
+
+// "YYYY-MM-DD HH:MM[:SS]" in local time
+static char *parse_date(char *s, time_t *when)
+{
+    struct tm tm;
+    int       used = 0;
+
+    memset(&tm, 0, sizeof(tm));
+    if ( sscanf(s, "%d-%d-%d %d:%d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                &tm.tm_hour, &tm.tm_min, &used) != 5 )
+        return NULL;
+    s += used;
+    if ( *s == ':' ) {
+        if ( sscanf(s, ":%d%n", &tm.tm_sec, &used) != 1 )
+            return NULL;
+        s += used;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    *when = mktime(&tm);
+    return s;
+}
+
+// the rest of the line, without the spaces around it
+static char *parse_label(char *s)
+{
+    char *end;
+
+    while ( isspace((unsigned char) *s) )
+        s++;
+    end = s + strlen(s);
+    while ( end > s && isspace((unsigned char) end[-1]) )
+        *--end = '\0';
+    return strdup(s);
+}
+
+/* One line of the alarm file; 0 if it doesn't make sense. */
+static int parse_alarm(char *line, time_t now)
+{
+    struct alarm       a, *copy;
+    unsigned long long bits;
+    char              *s = line;
+
+    memset(&a, 0, sizeof(a));
+
+    if ( *s == '@' ) {
+        if ( ( s = parse_date(s + 1, &a.when) ) == NULL || a.when == -1 )
+            return 0;
+        if ( a.when <= now )
+            return 1;   // already gone by; nothing to do
+    } else {
+        if ( ( s = parse_field(s, 0, 59, &a.minutes, NULL) ) == NULL )
+            return 0;
+        if ( ( s = parse_field(s, 0, 23, &bits, NULL) ) == NULL )
+            return 0;
+        a.hours = bits;
+        if ( ( s = parse_field(s, 1, 31, &bits, &a.any_mday) ) == NULL )
+            return 0;
+        a.mdays = bits;
+        if ( ( s = parse_field(s, 1, 12, &bits, NULL) ) == NULL )
+            return 0;
+        a.months = bits;
+        if ( ( s = parse_field(s, 0, 7, &bits, &a.any_wday) ) == NULL )
+            return 0;
+        a.wdays = bits | ( bits >> 7 );   // 7 is Sunday too
+        a.recurring = 1;
+        if ( ( a.when = next_time(&a, now) ) == 0 )
+            return 0;
+    }
+    a.label = parse_label(s);
+
+    if ( ( copy = malloc(sizeof(a)) ) == NULL ) {
+        perror("Could not add alarm");
+        exit(1);
+    }
+    *copy = a;
+    push(copy);
+    return 1;
+}
+
+/* Read the alarm file.  A line that doesn't make sense stops the
+ * clock, with its line number, rather than leave an alarm out.
+ */
+void load_alarms(char *file)
+{
+    FILE  *in;
+    char   line[256];
+    char  *s;
+    int    number = 0;
+    struct timespec now;
+
+    if ( ( in = fopen(file, "r") ) == NULL ) {
+        perror(file);
+        exit(1);
+    }
+    read_clock(&now);
+
+    while ( fgets(line, sizeof(line) - 1, in) ) {
+        number++;
+        line[strcspn(line, "\n")] = '\0';
+        strcat(line, " ");   // every field ends in a space
+
+        for (s = line; isspace((unsigned char) *s); s++)
+            ;
+        if ( *s == '\0' || *s == '#' )
+            continue;
+        if ( ! parse_alarm(s, now.tv_sec) ) {
+            fprintf(stderr, "%s, line %d: not an alarm\n", file, number);
+            exit(1);
+        }
+    }
+    fclose(in);
+}
+
+/* Called every tick.  Takes every alarm that's due off the heap (and
+ * puts recurring ones back for next time).  Returns how many went off,
+ * and copies the label of the last one into "label", which holds
+ * "size" bytes.
+ */
+int alarms_due(time_t now, char *label, int size)
+{
+    struct alarm *a;
+    int           fired = 0;
+
+    while ( nalarms > 0 && heap[0]->when <= now ) {
+        a = pop();
+        snprintf(label, size, "%s", a->label);
+        fired++;
+
+        if ( a->recurring && ( a->when = next_time(a, now) ) != 0 ) {
+            push(a);
+        } else {
+            free(a->label);
+            free(a);
+        }
+    }
+    return fired;
+}
@@ -0,0 +1,228 @@
+/* batch.c -- formatting a lot of times at once, for logs and such
+ *
+ * "clock -f text" reads epoch seconds, one to a line, and writes each
+ * as the clock would show it, with the -a, -d, -r, -o and -z flags
+ * given before it; the rest of the line is copied after it, so
+ * "clock -f text < log" turns a log's timestamps into times.  With -r,
+ * a fraction after the seconds gives the hundredths.  Lines that don't
+ * start with a number are copied as they are.
+ *
+ * "clock -f led" writes the 8 LED bytes (see LED-layout.txt) for each
+ * time instead, and skips lines that don't start with a number.
+ *
+ * The input is a file named after the flags, or standard input; a
+ * plain file is mapped into memory instead of read.  Either way the
+ * times go through the clock core (see clockcore.h), just as they do
+ * on a clock face, so the two can't disagree.
+ *
+ * Logs are mostly in order, so converting a time is usually a
+ * subtraction from the midnight before it: localtime() or the zone
+ * file is only needed for a new day.
+ */
+
+#include "clock.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+static int       led_frames;   // write LED bytes, not text
+static clockcore *batch;       // view properties, offset and zone
+static unsigned long skipped;  // lines with no time on them
+
+/* The day we're in: midnight and the next one, and the broken-down
+ * time at midnight.  Only a day with the same offset from UTC all
+ * day (no daylight saving change) is kept; end is 0 otherwise.
+ */
+static struct day {
+    time_t    start;
+    time_t    end;
+    struct tm tm;
+} today;
+
+static struct tm *batch_time(time_t t)
+{
+    static struct tm dateinfo;
+    struct tm  last;
+    long       secs;
+
+    if ( t >= today.start && t < today.end ) {
+        secs = t - today.start;
+        dateinfo = today.tm;
+        dateinfo.tm_hour = secs / 3600;
+        dateinfo.tm_min = secs / 60 % 60;
+        dateinfo.tm_sec = secs % 60;
+        return &dateinfo;
+    }
+
+    time_in_zone_r(batch, t, &dateinfo);
+    today.end = 0;
+    today.start = t - ( dateinfo.tm_hour * 3600 + dateinfo.tm_min * 60
+                        + dateinfo.tm_sec );
+
+    // the midnight before t and the last second of the day have to be
+    // the start and end of this date, or the offset changes in between
+    time_in_zone_r(batch, today.start, &today.tm);
+    if ( today.tm.tm_hour != 0 || today.tm.tm_min != 0
+         || today.tm.tm_sec != 0 || today.tm.tm_mday != dateinfo.tm_mday )
+        return &dateinfo;
+    time_in_zone_r(batch, today.start + 86399, &last);
+    if ( last.tm_hour != 23 || last.tm_min != 59 || last.tm_sec != 59
+         || last.tm_mday != dateinfo.tm_mday )
+        return &dateinfo;
+    today.end = today.start + 86400;
+
+    return &dateinfo;
+}
+
+// one line, from "line" up to (not including) the newline at "end"
+static void format_line(char *line, char *end)
+{
+    char      *p = line;
+    time_t     t = 0;
+    int        hundredths = 0;
+    struct tm *dateinfo;
+    digit      frame[8];
+    char       timestring[CLOCKCORE_TIMESTR];
+
+    while ( p < end && p - line < 18 && *p >= '0' && *p <= '9' )
+        t = t * 10 + ( *p++ - '0' );
+
+    if ( p == line ) {
+        if ( led_frames ) {
+            skipped++;
+        } else {
+            fwrite(line, 1, end - line, stdout);
+            putchar('\n');
+        }
+        return;
+    }
+
+    // hundredths from a fraction; the rest of its digits are dropped
+    if ( p < end && *p == '.' ) {
+        p++;
+        if ( p < end && *p >= '0' && *p <= '9' )
+            hundredths = ( *p++ - '0' ) * 10;
+        if ( p < end && *p >= '0' && *p <= '9' )
+            hundredths += *p++ - '0';
+        while ( p < end && *p >= '0' && *p <= '9' )
+            p++;
+    }
+
+    set_hundredths_r(batch, hundredths);
+    dateinfo = batch_time(t);
+
+    if ( led_frames ) {
+        encode_led_r(batch, dateinfo, frame);
+        fwrite(frame, 1, sizeof(frame), stdout);
+    } else {
+        fputs(make_timestring_r(batch, dateinfo, 1, timestring), stdout);
+        fwrite(p, 1, end - p, stdout);
+        putchar('\n');
+    }
+}
+
+/* Format the whole lines in "text" up to "end", and the part of one
+ * at the end if there's no more to come; returns where the part of a
+ * line left over starts.
+ */
+static char *format_lines(char *text, char *end, int last)
+{
+    char *eol;
+
+    while ( ( eol = memchr(text, '\n', end - text) ) != NULL ) {
+        format_line(text, eol);
+        text = eol + 1;
+    }
+    if ( last && text < end ) {
+        format_line(text, end);
+        text = end;
+    }
+    return text;
+}
+
+// a plain file all at once, from memory; 0 if "fd" isn't one
+static int format_mapped(int fd)
+{
+    struct stat info;
+    char       *text;
+
+    if ( fstat(fd, &info) == -1 || ! S_ISREG(info.st_mode) )
+        return 0;
+    if ( info.st_size == 0 )
+        return 1;
+
+    text = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if ( text == MAP_FAILED )
+        return 0;   // read it instead
+    madvise(text, info.st_size, MADV_SEQUENTIAL);
+
+    format_lines(text, text + info.st_size, 1);
+    munmap(text, info.st_size);
+    return 1;
+}
+
+// anything else a buffer at a time, as it comes
+static void format_stream(int fd, char *name)
+{
+    static char buffer[1 << 16];
+    size_t      have = 0;
+    ssize_t     got;
+    char       *rest;
+
+    while ( ( got = read(fd, buffer + have, sizeof(buffer) - have) ) > 0 ) {
+        have += got;
+        rest = format_lines(buffer, buffer + have, 0);
+        if ( rest == buffer && have == sizeof(buffer) )
+            rest = format_lines(buffer, buffer + have, 1);  // a huge line
+        have = buffer + have - rest;
+        memmove(buffer, rest, have);
+        fflush(stdout);   // a pipe gets its times as they come
+    }
+    if ( got == -1 ) {
+        perror(name);
+        exit(1);
+    }
+    format_lines(buffer, buffer + have, 1);
+}
+
+/* Format the times in "file" (NULL for standard input) as "kind" says,
+ * "text" or "led", with the view properties, offset and zone of
+ * "settings", and exit.
+ */
+void format_times(char *kind, clockcore *settings, char *file)
+{
+    char *name = file ? file : "(standard input)";
+    int   fd = STDIN_FILENO;
+
+    if ( strcmp(kind, "text") == 0 )
+        led_frames = 0;
+    else if ( strcmp(kind, "led") == 0 )
+        led_frames = 1;
+    else {
+        fprintf(stderr, "Times can be formatted as \"text\" or \"led\", "
+                        "not \"%s\".\n", kind);
+        exit(1);
+    }
+
+    if ( file && ( fd = open(file, O_RDONLY) ) == -1 ) {
+        perror(file);
+        exit(1);
+    }
+
+    batch = settings;
+    set_view_properties_r(batch, get_view_properties_r(batch)
+                                 & ~( LED_MODE | TEST_MODE ));
+    setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+
+    if ( ! format_mapped(fd) )
+        format_stream(fd, name);
+
+    if ( fflush(stdout) == EOF ) {
+        perror("Could not write times");
+        exit(1);
+    }
+    if ( skipped )
+        fprintf(stderr, "%lu lines had no time on them\n", skipped);
+    exit(0);
+}
@@ -0,0 +1,348 @@
+/* bench.c -- headless benchmark for the clock's tick/render path
+ *
+ * Runs tick(), make_timestring(), show_led() and display() over and
+ * over against a fake clock that moves one second and one hundredth
+ * per call, for every combination of view properties, and reports
+ * nanoseconds, memory allocations and system calls per operation.
+ *
+ * Everything is drawn on a pseudo-terminal, with a child process at
+ * the other end throwing away what it reads, so what we time is our
+ * own code plus the terminal writes a real clock makes.  The LED panel
+ * uses the "ansi" backend unless CLOCKLEDBACKEND says otherwise
+ * ("curses" works too; "null" times nothing but our own code).
+ *
+ * "make test" (clocktest.c) checks that what we time is also right.
+ *
+ * Usage: clockbench [-n iterations]
+ */
+
+#include "clock.h"
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <pty.h>
+
+/* FAKE CLOCK */
+
+// a Tuesday afternoon, so 12-hour and 24-hour strings differ
+static struct timespec fake_now = { 1600185600 + 13 * 3600, 0 };
+
+static void fake_clock(struct timespec *now)
+{
+    *now = fake_now;
+}
+
+
+/* ALLOCATION COUNTING
+ *
+ * Defining malloc() and friends here overrides the C library's for
+ * the whole program (the library calls them too), so we see every
+ * allocation.  The real work is passed on to glibc.
+ */
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void  __libc_free(void *);
+
+static long allocations = 0;
+
+void *malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+
+/* SYSTEM CALL COUNTING
+ *
+ * Counts raw_syscalls:sys_enter for this process with perf_event_open.
+ * That needs tracefs and permission; if we can't get it, we say "-".
+ */
+static int syscall_counter = -1;
+
+static int tracepoint_id(void)
+{
+    static char *paths[] = {
+        "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+        "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+    };
+    FILE *f;
+    int   id, i;
+
+    for (i = 0; i < 2; i++) {
+        if ( ( f = fopen(paths[i], "r") ) == NULL )
+            continue;
+        if ( fscanf(f, "%d", &id) != 1 )
+            id = -1;
+        fclose(f);
+        return id;
+    }
+    return -1;
+}
+
+static void start_syscall_counter(void)
+{
+    struct perf_event_attr attr;
+    int                    id = tracepoint_id();
+
+    if ( id < 0 )
+        return;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.size = sizeof(attr);
+    attr.config = id;
+    attr.disabled = 1;
+    attr.exclude_kernel = 0;
+
+    syscall_counter = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long read_syscall_counter(void)
+{
+    uint64_t count;
+
+    if ( syscall_counter == -1 )
+        return -1;
+    if ( read(syscall_counter, &count, sizeof(count)) != sizeof(count) )
+        return -1;
+    return (long) count;
+}
+
+
+/* THE BENCHMARKS */
+
+// a second and a hundredth later, so hires frames change too
+static void advance(void)
+{
+    fake_now.tv_sec++;
+    fake_now.tv_nsec += 10000000;
+    if ( fake_now.tv_nsec >= 1000000000 ) {
+        fake_now.tv_sec++;
+        fake_now.tv_nsec -= 1000000000;
+    }
+}
+
+static struct tm *bench_tm(void)
+{
+    static struct tm dateinfo;
+    time_t t = fake_now.tv_sec;
+
+    set_hundredths(fake_now.tv_nsec / 10000000);
+    advance();
+    return time_in_zone_r(current_face()->core, t, &dateinfo);
+}
+
+static void bench_tick(void)
+{
+    tick(0);
+    advance();
+}
+
+static void bench_timestring(void)
+{
+    make_timestring(bench_tm(), 0);
+}
+
+static void bench_timestring_dividers(void)
+{
+    make_timestring(bench_tm(), 1);
+}
+
+static void bench_show_led(void)
+{
+    show_led(bench_tm());
+}
+
+static void bench_display(void)
+{
+    digit *where = get_display_location();
+
+    where[fake_now.tv_sec % 6] ^= 0x7f;   // pretend one digit changed
+    fake_now.tv_sec++;
+    display();
+    flush_display();
+}
+
+struct benchmark {
+    char  *name;
+    void (*run)(void);
+};
+
+static struct benchmark benchmarks[] = {
+    { "tick",              bench_tick },
+    { "make_timestring",   bench_timestring },
+    { "make_timestring/d", bench_timestring_dividers },
+    { "show_led",          bench_show_led },
+    { "display",           bench_display },
+};
+
+#define NBENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static double elapsed_ns(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e9
+         + (end->tv_nsec - start->tv_nsec);
+}
+
+// "ampm+date+led" and so on; "24h" when nothing is set
+static char *props_name(int props)
+{
+    static char name[40];
+
+    name[0] = '\0';
+    strcat(name, ( props & AMPM_MODE ) ? "ampm" : "24h");
+    if ( props & HIRES_MODE ) strcat(name, "+hires");
+    if ( props & DATE_MODE ) strcat(name, "+date");
+    if ( props & LED_MODE )  strcat(name, "+led");
+    if ( props & TEST_MODE ) strcat(name, "+test");
+    if ( props & ALARM_MODE ) strcat(name, "+alarm");
+    return name;
+}
+
+#define ALL_PROPS (AMPM_MODE|HIRES_MODE|DATE_MODE|LED_MODE|TEST_MODE)
+
+static void run_benchmark(struct benchmark *b, int props, long iterations)
+{
+    struct timespec start, end;
+    long            allocs, calls;
+    long            i;
+
+    set_view_properties(props);
+
+    // warm up caches (and the face's minute) before timing
+    for (i = 0; i < 1000; i++)
+        b->run();
+
+    allocs = allocations;
+    calls = read_syscall_counter();
+    if ( syscall_counter != -1 )
+        ioctl(syscall_counter, PERF_EVENT_IOC_ENABLE, 0);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < iterations; i++)
+        b->run();
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if ( syscall_counter != -1 )
+        ioctl(syscall_counter, PERF_EVENT_IOC_DISABLE, 0);
+    allocs = allocations - allocs;
+
+    fprintf(stderr, "%-18s %-24s %10.1f %10.3f ",
+            b->name, props_name(props),
+            elapsed_ns(&start, &end) / iterations,
+            (double) allocs / iterations);
+    if ( calls == -1 )
+        fprintf(stderr, "%10s\n", "-");
+    else
+        fprintf(stderr, "%10.3f\n",
+                (double) (read_syscall_counter() - calls) / iterations);
+}
+
+
+/* Make a pseudo-terminal our standard input and output, as big as a
+ * usual window, and start a child that reads and discards everything
+ * written to it.  The child stops when we exit and close our end.
+ */
+static void pseudo_terminal(void)
+{
+    struct winsize size = { 30, 100, 0, 0 };
+    char           discard[4096];
+    int            master, slave;
+
+    if ( openpty(&master, &slave, NULL, NULL, &size) == -1 ) {
+        perror("Could not open a pseudo-terminal");
+        exit(1);
+    }
+
+    switch ( fork() ) {
+        case -1:
+            perror("fork");
+            exit(1);
+        case 0:
+            close(slave);
+            while ( read(master, discard, sizeof(discard)) > 0 )
+                ;
+            _exit(0);
+    }
+
+    close(master);
+    if ( dup2(slave, STDIN_FILENO) == -1 || dup2(slave, STDOUT_FILENO) == -1 ) {
+        perror("Could not use the pseudo-terminal");
+        exit(1);
+    }
+    close(slave);
+}
+
+int main(int argc, char *argv[])
+{
+    long iterations = 1000000;
+    int  letter;
+    int  props;
+    unsigned int b;
+
+    while ( ( letter = getopt(argc, argv, "n:")) != -1 ) {
+        switch (letter) {
+            case 'n':  iterations = atol(optarg);  break;
+            default:
+                fprintf(stderr, "Usage: %s [-n iterations]\n", argv[0]);
+                exit(1);
+        }
+    }
+    if ( iterations < 1 )
+        iterations = 1;
+
+    pseudo_terminal();
+    if ( getenv("CLOCKLEDBACKEND") == NULL )
+        setenv("CLOCKLEDBACKEND", "ansi", 1);
+    start_display();
+
+    set_clock_source(fake_clock);
+    start_syscall_counter();
+
+    // one clock face on our display; keep date and test mode
+    // from timing out under us
+    add_face(NULL, 0);
+    set_mode_end_r(current_face()->core, DATE_MODE | TEST_MODE, INT_MAX);
+
+    fprintf(stderr, "LED panel: %s backend on a pseudo-terminal\n",
+            getenv("CLOCKLEDBACKEND"));
+    fprintf(stderr, "%-18s %-24s %10s %10s %10s\n",
+            "benchmark", "view", "ns/op", "allocs/op", "syscalls/op");
+
+    for (b = 0; b < NBENCHMARKS; b++) {
+        // display() doesn't look at the view properties
+        if ( benchmarks[b].run == bench_display ) {
+            run_benchmark(&benchmarks[b], LED_MODE, iterations);
+            continue;
+        }
+        for (props = 0; props <= ALL_PROPS; props++) {
+            if ( props & ~ALL_PROPS )
+                continue;
+            run_benchmark(&benchmarks[b], props, iterations);
+        }
+    }
+
+    end_display();
+    return 0;
+}
@@ -7,6 +7,9 @@
 
 #include "clock.h"
 
+#include <sys/signalfd.h>
+#include <getopt.h>
+
 /* CONTROLLER */
 
 static char bugaddress[]="kilroy@elvis.rowan.edu";
@@ -23,28 +26,188 @@ void version()
 void usage(char *progname)
 {
     fprintf(stderr, "This program displays a realtime clock.\n");
-    fprintf(stderr, "Usage: %s [-advh] [-o number]\n", progname);
+    fprintf(stderr, "Usage: %s [-advh] [-o number] [-z zone] [-p tty]...\n"
+                    "       [-c countdown] [-i interval] [-A file] [-r rate]\n"
+                    "       [-F fps] [-L msec] [-M name] [-S file]\n"
+                    "       [-R file | -P file] [-f text|led [file]]\n",
+                    progname);
     fprintf(stderr, "  -a    : am/pm instead of 24 hour\n");
     fprintf(stderr, "  -d    : show date instead of time\n");
     fprintf(stderr, "  -l    : use simulated LED display\n");
     fprintf(stderr, "  -o #  : offset the time by # seconds \n");
+    fprintf(stderr, "  -z z  : show the time in zone z, like Asia/Tokyo\n");
+    fprintf(stderr, "  -c t  : count down from t ([[h:]m:]s), or to noon\n"
+                    "          or midnight (LED mode: start it with space)\n");
+    fprintf(stderr, "  -i t  : repeating countdown of t ([[h:]m:]s)\n");
+    fprintf(stderr, "  -A f  : alarms from file f (crontab-like; see alarms.c),\n"
+                    "          in the host's local time whatever -o and -z say\n");
+    fprintf(stderr, "  -p t  : also run an LED panel on terminal t, using\n"
+                    "          the flags given before it\n");
+    fprintf(stderr, "  -r #  : update # times a second (up to 100), and\n"
+                    "          show hundredths: MM:SS.cc on the LEDs\n");
+    fprintf(stderr, "  -F #  : draw at most # frames a second\n");
+    fprintf(stderr, "  -L #  : tick # milliseconds early to allow for drawing\n");
+    fprintf(stderr, "  -M n  : share the LED frames in shared memory n\n"
+                    "          (like /clock), for ledwatch and the like\n");
+    fprintf(stderr, "  -S f  : write stats to file f every few seconds\n");
+    fprintf(stderr, "  -R f  : record the ticks, keys and frames in file f\n");
+    fprintf(stderr, "  -P f  : play back file f, with the same flags, as\n"
+                    "          fast as possible, and check the frames\n");
+    fprintf(stderr, "  -f k  : (or --format k) read epoch seconds, one a line,\n"
+                    "          from file or standard input, and write each\n"
+                    "          as text (k is text) or 8 LED bytes (k is led)\n"
+                    "          using the flags before it; see batch.c\n");
     fprintf(stderr, "  -v    : show version information\n");
     fprintf(stderr, "  -h    : this help message\n");
     fprintf(stderr, "report bugs to %s \n", bugaddress);
     exit (0);
 }
 
-// These store timestamps for when the different modes end
-int test_mode_end;
-int date_mode_end;
+/* All the clock faces we're running, and the one we're working on.
+ * Each face has its own panel, view properties, offset, zone and mode
+ * timeouts; see "struct face" in clock.h.
+ */
+struct face *faces = NULL;
+int          nfaces = 0;
+struct face *current = NULL;
+
+/* The offset and zone from -o and -z, which the faces added after
+ * them start with, and which -f formats times with.
+ */
+static clockcore *flags(void)
+{
+    static clockcore *given = NULL;
+
+    if ( given == NULL && ( given = clockcore_new() ) == NULL ) {
+        perror("Could not start the clock");
+        exit(1);
+    }
+    return given;
+}
+
+struct face *add_face(char *tty, int view_props)
+{
+    if ( nfaces == MAX_FACES ) {
+        fprintf(stderr, "Too many clock faces: at most %d\n", MAX_FACES);
+        exit(1);
+    }
+    faces = realloc(faces, (nfaces + 1) * sizeof(struct face));
+    if ( faces == NULL ) {
+        perror("Could not add clock face");
+        exit(1);
+    }
+
+    current = &faces[nfaces++];
+    memset(current, 0, sizeof(*current));
+    current->tty = tty;
+    if ( ( current->core = clockcore_new() ) == NULL ) {
+        perror("Could not add clock face");
+        exit(1);
+    }
+    set_view_properties_r(current->core, view_props);
+    set_offset_r(current->core, get_offset_r(flags()));
+    set_zone_r(current->core, get_zone_r(flags()));
+    current->timer = get_timer();
+
+    return current;
+}
+
+struct face *current_face(void)
+{
+    return current;
+}
 
+struct face *face_number(int n)
+{
+    return ( n >= 0 && n < nfaces ) ? &faces[n] : NULL;
+}
+
+// make "f" the face that the view, the driver and the keys work on
+void select_face(struct face *f)
+{
+    current = f;
+    select_panel(f->panel);
+    set_view_core(f->core);
+}
+
+// has to be exactly 78 chars
+char title[] = "----------------------------"
+               " Steven was here at: "
+               "----------------------------";
+
+// when the keys now being read came in, for the stats
+long long key_arrived;
+
+/* The driver calls this for each key.  We only queue it; the keys are
+ * handled after the event loop has read everything that's waiting.
+ */
+void queue_key(keybits KeyCode)
+{
+    struct key_event key;
+
+    key.key = KeyCode;
+    key.face = current - faces;
+    key.arrived = key_arrived;
+    if ( ! put_key(&key) )
+        stats_key_dropped();
+}
+
+/* The timer keys: switch timers, start or stop, and lap (or reset, if
+ * it's stopped).  "now" is the wall clock, for mode timeouts and
+ * countdowns to noon or midnight, and "mono" the timers' clock.
+ */
+void timer_key(int which, struct timespec *now, long long mono)
+{
+    struct face *face = current;
+    struct tm    dateinfo;
+
+    timer_reading(&face->timer, mono);   // catch up with a finished countdown
+    face->lap_mode_end = 0;
+
+    switch ( which ) {
+        case 'm':
+            timer_next_kind(&face->timer);
+            break;
+        case 'g':
+            if ( face->timer.running )
+                timer_stop(&face->timer, mono);
+            else
+                timer_start(&face->timer, mono,
+                            time_in_zone_r(face->core, now->tv_sec,
+                                           &dateinfo));
+            break;
+        case 'l':
+            if ( face->timer.running ) {
+                face->lap_time = timer_lap(&face->timer, mono);
+                face->lap_mode_end = (int) now->tv_sec + 5;
+            } else {
+                timer_reset(&face->timer);
+            }
+            break;
+    }
+}
+
+// apply one key to the current face; the caller redraws
 void process_key(keybits KeyCode)
 {
     void stop_clock(void);
+    struct face *face = current;
     int KeyRow, KeyCol;
-    int view_props;
-    time_t now;
-    
+    struct timespec now;
+    long long mono;
+
+    read_clock(&now);
+    mono = read_monotonic();
+    record_key(face - faces, KeyCode, now.tv_sec, mono);
+
+    // any key stops an alarm
+    if ( now.tv_sec <= face->alarm_end ) {
+        face->alarm_end = 0;
+        face->title_borrowed = 0;
+        if ( get_view_properties() & LED_MODE )
+            set_title_bar(title);
+    }
+
     if ( ( KeyCode & 0xff00 ) == 0 ) {  // no ASCII code, so mouse hit
 
         // TODO: figure out KeyRow and KeyCol
@@ -53,30 +216,11 @@ void process_key(keybits KeyCode)
 
         if (KeyRow == 0) {
             switch (KeyCol) {
-                case 0: // 24-hour mode
-                    view_props = get_view_properties();
-                    view_props &= ( ~ AMPM_MODE );
-                    set_view_properties (view_props);
-                    KeyCode = 0;
-                    break;
-                case 1:
-                    view_props = get_view_properties();
-                    view_props |= ( AMPM_MODE );
-                    set_view_properties (view_props);
-                    KeyCode = 0;
-                    break;
+                case 0: // 24-hour mode, am/pm, date, test: the same
+                case 1: // as their keys, which the clock core handles
                 case 2:
-                    view_props = get_view_properties();
-                    view_props |= (DATE_MODE);
-                    set_view_properties(view_props);
-                    date_mode_end = (int) time(NULL) + 5; //5 second pause
-                    KeyCode = 0;
-                    break;
                 case 3:
-                    view_props = get_view_properties();                    
-                    view_props |= (TEST_MODE); //isnt this for the title bar? if so, wheres the var for test mode
-                    set_view_properties(view_props);
-                    test_mode_end = (int) time(NULL) + 5; //5 second pause as well
+                    process_key_r(face->core, "2adt"[KeyCol], now.tv_sec);
                     KeyCode = 0;
                     break;
                 case 4:
@@ -85,7 +229,21 @@ void process_key(keybits KeyCode)
             }
         } else if (KeyRow == 1) {
             switch (KeyCol) {
-                case 0:
+                case 0: // show stats in the title bar
+                    face->stats_mode_end = (int) now.tv_sec + 5;
+                    KeyCode = 0;
+                    break;
+                case 1: // next timer: stopwatch, countdown, ...
+                    timer_key('m', &now, mono);
+                    KeyCode = 0;
+                    break;
+                case 2: // start or stop the timer
+                    timer_key('g', &now, mono);
+                    KeyCode = 0;
+                    break;
+                case 3: // lap, or reset when stopped
+                    timer_key('l', &now, mono);
+                    KeyCode = 0;
                     break;
             }
         }        
@@ -93,31 +251,22 @@ void process_key(keybits KeyCode)
         // figure out ASCII value from first 8 bits
         // right now any key goes to 24-hour mode
         KeyCode >>= 8;
+        // '2', 'a', 'd' and 't' change the view; see clockcore.h
+        if ( process_key_r(face->core, KeyCode, now.tv_sec) )
+            KeyCode = 0;
         switch( KeyCode ) {
-            case '2':
-                view_props = get_view_properties();
-                view_props &= ( ~ AMPM_MODE );
-                set_view_properties (view_props);
+            case 's':
+                face->stats_mode_end = (int) now.tv_sec + 5;
                 KeyCode = 0;
                 break;
-            case 'a':
-                view_props = get_view_properties();
-                view_props |= ( AMPM_MODE );
-                set_view_properties (view_props);
+            case 'm':
+            case 'g':
+            case 'l':
+                timer_key(KeyCode, &now, mono);
                 KeyCode = 0;
                 break;
-            case 'd':
-                view_props = get_view_properties();
-                view_props |= (DATE_MODE);
-                set_view_properties (view_props);
-                date_mode_end = (int) time(NULL) + 5; //5 second pause
-                KeyCode = 0;
-                break;
-            case 't':
-                view_props = get_view_properties();
-                view_props |= (TEST_MODE); //isnt this for the title bar? if so, wheres the var for test mode
-                set_view_properties (view_props);
-                test_mode_end = (int) time(NULL) + 5; //5 second pause
+            case ' ':
+                timer_key('g', &now, mono);
                 KeyCode = 0;
                 break;
             case 'q':
@@ -125,9 +274,64 @@ void process_key(keybits KeyCode)
                 break;
         }
     }
+}
+
+// when each key handled since the last frame came in, for the stats
+long long keys_waiting[KEY_QUEUE_SIZE];
+int       nkeys_waiting = 0;
+
+/* Apply every key that came in, and ask for a frame to show them. */
+void process_keys(void)
+{
+    struct key_event key;
+
+    while ( take_key(&key) ) {
+        select_face(&faces[key.face]);
+        process_key(key.key);
+        if ( nkeys_waiting < KEY_QUEUE_SIZE )
+            keys_waiting[nkeys_waiting++] = key.arrived;
+
+        // force update when keys are hit
+        request_frame(FRAME_KEY);
+    }
+}
+
+/* The frame scheduler calls this to draw every face; "why" has the
+ * FRAME_ bits for everything that asked since the last frame.
+ */
+void draw_frame(int why)
+{
+    long long done;
+    int       i;
+
+    if ( why & FRAME_RESIZE ) {
+        select_panel(NULL);
+        resize_display();
+    }
 
-    // force update when keys are hit
     tick(0);
+    flush_display();
+
+    // what every face showed, for a recording; this is where frames
+    // for keys, timers and ticks alike go out
+    for (i = 0; i < nfaces; i++) {
+        select_face(&faces[i]);
+        record_frame(i, get_view_properties(),
+                     ( get_view_properties() & LED_MODE )
+                     ? get_display_location() : NULL);
+    }
+
+    done = monotonic_ns();
+    for (i = 0; i < nkeys_waiting; i++)
+        stats_key(done - keys_waiting[i]);
+    nkeys_waiting = 0;
+}
+
+// the event loop calls this once it has handled everything that was ready
+void events_done(void)
+{
+    process_keys();
+    run_frames();
 }
 
 void stop_clock()
@@ -136,25 +340,137 @@ void stop_clock()
     exit(0);
 }
 
+// the event loop calls this when there's a key or mouse click to read
+void key_ready(int fd)
+{
+    int i;
+
+    key_arrived = monotonic_ns();
+
+    // find the face whose panel the key came from
+    for (i = 0; i < nfaces; i++) {
+        select_face(&faces[i]);
+        if ( get_key_fd() == fd ) {
+            get_key();
+            return;
+        }
+    }
+}
+
+// the event loop calls this when one of the signals we watch arrives
+void signal_ready(int fd)
+{
+    struct signalfd_siginfo info;
+
+    if ( read(fd, &info, sizeof(info)) != sizeof(info) )
+        return;
+
+    switch ( info.ssi_signo ) {
+        case SIGWINCH:  // only our own terminal sends us this
+            request_frame(FRAME_RESIZE);
+            break;
+        case SIGINT:
+        case SIGTERM:
+            stop_clock();
+            break;
+    }
+}
+
+/* Signals we care about are blocked and read from a signalfd(2) in
+ * the event loop, so none of our code runs inside a signal handler.
+ * This has to happen before curses starts, so curses' own handlers
+ * never see them.
+ */
+void watch_signals(void)
+{
+    sigset_t signals;
+    int      signal_fd;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGWINCH);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+
+    if ( sigprocmask(SIG_BLOCK, &signals, NULL) == -1 ) {
+        perror("Could not block signals");
+        exit(1);
+    }
+
+    signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if ( signal_fd == -1 ) {
+        perror("Could not watch signals");
+        exit(1);
+    }
+
+    add_event_source(signal_fd, signal_ready);
+}
+
+#ifndef NO_MAIN   // the benchmark links this file with its own main()
+// the zone -z names
+static zone *zone_flag(char *name)
+{
+    zone *z = load_zone(name);
+
+    if ( z == NULL ) {
+        fprintf(stderr, "Unknown time zone \"%s\".\n", name);
+        exit(1);
+    }
+    return z;
+}
+
 int main(int argc, char *argv[])
 {
     int letter;  // option character
+    int i;
 
     // next three are for setting view properties
     int view_props;
     int ampm = 0;     // default to 24hr
     int date = 0;     // default to time
     int LED  = 0;     // default to text
+    long long mono;
+    struct tm dateinfo;
+    int hires = 0;    // default to whole seconds
+    int panels = 0;   // how many -p flags
+    struct timespec started;
+    char *format = NULL;  // -f: format times from a file, not run a clock
+    static struct option long_options[] = {
+        { "format", required_argument, NULL, 'f' },
+        { NULL, 0, NULL, 0 }
+    };
     
 
     // loop through all the options; getopt() can handle together or apart
-    while ( ( letter = getopt(argc, argv, "adlo:vh")) != -1 ) {
+    while ( ( letter = getopt_long(argc, argv,
+                                   "adlo:p:r:z:c:i:f:A:F:L:M:P:R:S:vh",
+                                   long_options, NULL)) != -1 ) {
         // *INDENT-OFF*
         switch (letter) {
             case 'a':  ampm = 1;               break;
             case 'd':  date = 1;               break;                
             case 'l':  LED  = 1;               break;
-            case 'o':  set_offset (atoi(optarg));  break;
+            case 'o':  set_offset_r (flags(), atoi(optarg));      break;
+            case 'z':  set_zone_r (flags(), zone_flag(optarg));   break;
+            case 'c':  set_countdown (optarg);     break;
+            case 'i':  set_interval (optarg);      break;
+            case 'A':  load_alarms (optarg);       break;
+            case 'p':  // a panel on another terminal, with the flags so far
+                       add_face(optarg, LED_MODE | (ampm ? AMPM_MODE : 0)
+                                                 | (date ? DATE_MODE : 0)
+                                                 | (hires ? HIRES_MODE : 0));
+                       panels++;
+                       break;
+            case 'r':  // ticks a second; more than one shows hundredths
+                       set_tick_rate (atoi(optarg));
+                       hires = ( atoi(optarg) > 1 );
+                       break;
+            case 'f':  format = optarg;               break;
+            case 'F':  set_max_fps (atoi(optarg));    break;
+            case 'L':  set_tick_lead (atoi(optarg));  break;
+            case 'M':  share_display (optarg);        break;
+            case 'P':  replay_from (optarg);          break;
+            case 'R':  record_to (optarg);            break;
+            case 'S':  set_stats_file (optarg);       break;
             case 'v':  version();              break;
             case 'h':  usage(argv[0]);         break;
 
@@ -178,55 +494,182 @@ int main(int argc, char *argv[])
         view_props |= DATE_MODE;  // note |= to switch on a bit
     if ( LED )
         view_props |= LED_MODE;
+    if ( hires )
+        view_props |= HIRES_MODE;
 
-    set_view_properties (view_props);
+    // formatting a file of times doesn't run a clock at all
+    if ( format ) {
+        set_view_properties_r(flags(), view_props);
+        format_times(format, flags(), optind < argc ? argv[optind] : NULL);
+    }
 
-    if (LED) { // set up the fancy display
-        start_display();
-        // has to be exactly 78 chars
-        set_title_bar("----------------------------"
-                      " Steven was here at: "
-                      "----------------------------");
-        register_keyhandler(process_key);
+    // our own terminal shows a clock too, unless it's only serving panels
+    if ( LED || panels == 0 )
+        add_face(NULL, view_props);
+
+    watch_signals();
+
+    for (i = 0; i < nfaces; i++) {
+        if ( ! ( get_view_properties_r(faces[i].core) & LED_MODE ) )
+            continue;
+
+        // set up the fancy display
+        if ( faces[i].tty )
+            faces[i].panel = open_panel(faces[i].tty);
+        else
+            start_display();
+        select_face(&faces[i]);
+
+        set_title_bar(title);
+        register_keyhandler(queue_key);
+        if ( get_key_fd() != -1 )
+            add_event_source(get_key_fd(), key_ready);
 
         // turn on some keys in row 2
+        set_key_text(0, "Stats");
+        set_key_text(1, "Timer");
     }
 
+    // text mode has no keys, so its countdowns start right away
+    record_start();
+    read_clock(&started);
+    mono = read_monotonic();
+    for (i = 0; i < nfaces; i++) {
+        if ( ! ( get_view_properties_r(faces[i].core) & LED_MODE ) )
+            timer_start(&faces[i].timer, mono,
+                        time_in_zone_r(faces[i].core, started.tv_sec,
+                                       &dateinfo));
+    }
+
+    replay();
+
     /* get the model running */
     start_timer();
+    after_events(events_done);
 
-    while (1) {
-        if (LED) {
-            get_key();
-        } else {
-            pause(); // wait for signal
-        }
-    }
+    run_event_loop();
 
     /* no return because never reached */
 }
+#endif
+
+
+/* Show the face's timer instead of the time of day, as if it were
+ * a time: hours, minutes and seconds, and hundredths in hires mode.
+ * Countdowns round up, so they reach zero when the time is really up.
+ */
+void show_timer(time_t now, long long mono)
+{
+    struct timer *t = &current->timer;
+    struct tm     reading;
+    long long     ns, unit;
+    long          units, secs;
+    int           props = get_view_properties();
+
+    unit = ( props & HIRES_MODE ) ? 10000000 : 1000000000;
+
+    if ( now <= current->lap_mode_end )
+        ns = current->lap_time;
+    else
+        ns = timer_reading(t, mono);
+
+    if ( t->kind == TIMER_STOPWATCH || now <= current->lap_mode_end )
+        units = ns / unit;
+    else
+        units = (ns + unit - 1) / unit;
+    secs = units * unit / 1000000000;
 
+    memset(&reading, 0, sizeof(reading));
+    reading.tm_hour = secs / 3600 % 100;
+    reading.tm_min = secs / 60 % 60;
+    reading.tm_sec = secs % 60;
+    reading.tm_mday = 1;
+    set_hundredths(( props & HIRES_MODE ) ? units % 100 : 0);
 
-/* This function is called is called by the model when a new
- * time is ready for display.
+    // a timer has no am or pm
+    set_view_properties(props & ~AMPM_MODE);
+    show(&reading);
+    set_view_properties(props);
+
+    // draw the next second when the timer gets there, not the clock;
+    // in hires mode the ticks come often enough anyway
+    if ( ! ( props & HIRES_MODE ) && ( ns = timer_next_change(t, mono, unit) ) )
+        frame_at(ns);
+}
+
+/* This function is called by the model when a new
+ * time is ready for display.  "now" is when the model read the clock,
+ * so the mode timeouts agree with the time being shown, and
+ * "hundredths" is how far into that second it was.
+ *
+ * Every face gets the same reading, and its clockcore works out the
+ * face's own time from it and ends its date and test modes.
  */
-void new_time(struct tm *dateinfo)
+void new_time(time_t now, int hundredths)
 {
     int view_props;
+    struct tm dateinfo;
+    long long mono = read_monotonic();
+    char alarm[81];
+    int i;
+
+    record_tick(now, hundredths, mono);
+
+    // an alarm goes off on every face
+    if ( alarms_due(now, alarm, sizeof(alarm)) ) {
+        for (i = 0; i < nfaces; i++) {
+            faces[i].alarm_end = now + ALARM_SECONDS;
+            frame_title(faces[i].alarm_title, *alarm ? alarm : "ALARM");
+        }
+    }
+
+    for (i = 0; i < nfaces; i++) {
+        select_face(&faces[i]);
 
-    time_t now = time( NULL );
+        // handle date and test mode, and find the face's time
+        new_time_r(current->core, now, hundredths, &dateinfo);
 
-    // handle date mode
-    if ( now > date_mode_end ) {
         view_props = get_view_properties();
-        view_props &= (~DATE_MODE);
+        if ( now <= current->alarm_end )
+            view_props |= ALARM_MODE;
+        else
+            view_props &= ~ALARM_MODE;
         set_view_properties(view_props);
+
+        // an alarm's label, or the stats, go in the title bar for a
+        // while, then the title comes back -- on whatever tick is
+        // next, even if the second after has been skipped
+        if ( view_props & LED_MODE ) {
+            if ( now <= current->alarm_end ) {
+                set_title_bar(current->alarm_title);
+                current->title_borrowed = 1;
+            } else if ( now <= current->stats_mode_end ) {
+                set_title_bar(stats_title());
+                current->title_borrowed = 1;
+            } else if ( current->title_borrowed ) {
+                set_title_bar(title);
+                current->title_borrowed = 0;
+            }
+        }
+
+        // the timer keys say what they'll do next
+        if ( view_props & LED_MODE ) {
+            if ( current->timer.kind == TIMER_OFF ) {
+                set_key_text(2, "");
+                set_key_text(3, "");
+            } else {
+                set_key_text(2, current->timer.running ? "Stop" : "Start");
+                set_key_text(3, current->timer.running ? "Lap" : "Reset");
+            }
+        }
+
+        if ( current->timer.kind != TIMER_OFF
+             && ! ( view_props & DATE_MODE ) ) {
+            show_timer(now, mono);
+        } else {
+            show(&dateinfo);
+        }
     }
-    if ( now > test_mode_end ) {
-       view_props = get_view_properties();
-       view_props &= (~TEST_MODE);
-       set_view_properties(view_props);
-    }    
 
-    show(dateinfo);
+    stats_update(now);
 }
@@ -14,16 +14,132 @@
 
 #include "LEDisplay.h"
 
+/* view prototypes, and the clock core's (zones among them) */
+#include "view.h"
+
+
+/* event loop prototypes */
+typedef void (*event_handler)(int fd);
+void add_event_source(int, event_handler);
+void run_event_loop(void);
+void after_events(void (*)(void));  // run once per batch of ready events
+
+/* key queue prototypes */
+#define KEY_QUEUE_SIZE 64    // must be a power of two
+struct key_event {
+    keybits   key;
+    int       face;        // which face's panel it came from
+    long long arrived;     // monotonic_ns() when it was read
+};
+int put_key(struct key_event *);   // 0 if the queue is full (never for a quit)
+int take_key(struct key_event *);  // 0 if the queue is empty
+int is_quit_key(keybits);          // 'q' or the Off button
+
+/* frame scheduler prototypes */
+#define FRAME_TIMER   0x01   // a new second
+#define FRAME_KEY     0x02   // a key changed something
+#define FRAME_RESIZE  0x04   // our terminal changed size
+#define FRAME_DUE     0x08   // a time asked for with frame_at()
+void set_max_fps(int);       // 0 for no limit
+void request_frame(int);     // FRAME_ bits saying why
+void frame_at(long long);    // a frame when monotonic_ns() gets there
+void run_frames(void);
+
+/* time source prototypes */
+void read_clock(struct timespec *);
+void set_clock_source(void (*)(struct timespec *)); // NULL for the real one
+long long read_monotonic(void);             // ns, for the timers
+void set_monotonic_source(long long (*)(void));     // NULL for the real one
+
+/* stats prototypes */
+long long monotonic_ns(void);
+void stats_ticks(unsigned long long);
+void stats_frame(long long);
+void stats_key(long long);
+void stats_key_dropped(void);     // the key queue was full
+char *stats_title(void);
+void set_stats_file(char *);
+void stats_update(time_t);
+
+/* stopwatch prototypes */
+#define TIMER_OFF        0   // the face shows the time of day
+#define TIMER_STOPWATCH  1
+#define TIMER_COUNTDOWN  2
+#define TIMER_INTERVAL   3   // counts down the same length over and over
+#define TIMER_KINDS      4
 
+struct timer {
+    int       kind;
+    int       running;
+    long long started;     // monotonic_ns() when last started
+    long long elapsed;     // time it ran before that
+    long long countdown;   // countdown length; 0 to use "target"
+    long      target;      // seconds after midnight to count down to, or -1
+    long long interval;    // interval length
+    long long length;      // length of the countdown now going
+    long long lap_at;      // elapsed time at the last lap
+    int       laps;
+};
+
+void set_countdown(char *);    // "noon", "midnight" or [[h:]m:]s
+void set_interval(char *);     // [[h:]m:]s
+struct timer get_timer(void);  // what new faces start with
+void timer_start(struct timer *, long long, struct tm *);
+void timer_stop(struct timer *, long long);
+void timer_reset(struct timer *);
+long long timer_lap(struct timer *, long long);
+void timer_next_kind(struct timer *);
+long long timer_reading(struct timer *, long long);
+long long timer_next_change(struct timer *, long long, long long);
+
+/* alarm prototypes */
+#define ALARM_SECONDS 30                 // how long one goes off for
+void load_alarms(char *);          // see alarms.c for the file format
+int  alarms_due(time_t, char *, int);  // how many went off, and a label
 
 /* model prototypes */
 void start_timer(void);
 void tick(int);
-void set_offset(int);
-int  get_offset(void);
+void set_tick_lead(int);
+void set_tick_rate(int);
+
+/* record and replay prototypes */
+void record_to(char *);      // write down the session in this file
+void replay_from(char *);    // play this file back instead of running
+void record_start(void);     // once the faces are set up
+void record_tick(time_t, int, long long);
+void record_key(int, keybits, time_t, long long);
+void record_frame(int, int, digit *);
+void replay(void);           // only returns if we're not playing back
+
+/* batch formatting prototypes */
+void format_times(char *, clockcore *, char *);  // "text" or "led"; exits
 
 /* controller prototypes */
-void new_time(struct tm *);
+void new_time(time_t, int);
+void process_key(keybits);
+void draw_frame(int);
 
-/* view prototypes */
-#include "view.h"
+/* A face is one clock the controller runs: a panel (or our own
+ * terminal) with its own view properties, offset, zone and mode
+ * timeouts.  The ones the clock core knows about are in "core".
+ */
+struct face {
+    char  *tty;            // terminal it's on; NULL for ours
+    panel *panel;
+    clockcore *core;       // see clockcore.h
+    int    stats_mode_end;
+    int    lap_mode_end;   // showing a lap time until then
+    int    alarm_end;      // an alarm is going off until then
+    char   alarm_title[81];
+    int    title_borrowed; // the title bar shows the alarm or the stats
+    long long lap_time;
+    struct timer timer;    // stopwatch and so on; see stopwatch.c
+};
+
+#define MAX_FACES 256     // replay.c records a face's number in a byte
+
+struct face *add_face(char *, int);
+struct face *current_face(void);
+struct face *face_number(int);     // NULL if there isn't one
+void select_face(struct face *);
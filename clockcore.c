@@ -0,0 +1,520 @@
+/* clockcore.c -- formatting for one clock, with no globals
+ *
+ * Everything a clock needs to remember is in its "struct clockcore",
+ * and the tables here never change.  See clockcore.h for how to use it.
+ */
+
+#include "clockcore.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Many panels show the same time in the same mode, so remember the
+ * last few frames and copy one instead of formatting it again.
+ * A frame depends only on the time (with the hundredths, in hires
+ * mode) and the AMPM, HIRES, DATE and ALARM bits.
+ */
+#define FRAME_CACHE 8
+#define NO_FRAME    UINT64_MAX
+
+struct frame {
+    uint64_t      when;      // see frame_key(); NO_FRAME if unused
+    int           props;
+    unsigned char bits[8];
+};
+
+typedef void (*formatter)(char *, struct tm *, int);
+
+struct clockcore {
+    int              view_props;
+    int              hundredths;
+    const formatter *format;         // for view_props, without and with
+                                     // dividers
+    int              offset;
+    zone            *zone;           // NULL for the TZ variable
+    time_t           date_mode_end;  // these store timestamps for when
+    time_t           test_mode_end;  // the different modes end
+    struct tm        minute;         // the last minute time_in_zone_r()
+    time_t           minute_start;   // worked out, and when it began
+    int              minute_valid;
+    struct frame     frames[FRAME_CACHE];
+};
+
+/* FORMATTERS
+ *
+ * Every string we make is three two-digit numbers with something
+ * between and after them, so instead of strftime(3) (which parses its
+ * format and looks at the locale every time) there's a function for
+ * each mode, picked when the mode changes.
+ *
+ * The digits of all three numbers come out of one multiply: x / 10 is
+ * (x * 103) >> 10 for anything under 100, and with the numbers in
+ * separate lanes of a 64-bit word, one multiply and one shift divide
+ * all three by ten.  The lanes are "stride" bits apart, so with 24
+ * they leave a byte between each pair for the dividers.
+ */
+static uint64_t ascii_pairs(unsigned a, unsigned b, unsigned c, int stride)
+{
+    uint64_t lane = 1 | (uint64_t) 1 << stride | (uint64_t) 1 << 2 * stride;
+    uint64_t v = a | (uint64_t) b << stride | (uint64_t) c << 2 * stride;
+    uint64_t tens = ( ( v * 103 ) >> 10 ) & ( lane * 0x0f );
+    uint64_t ones = v - tens * 10;
+
+    return ( tens | ones << 8 ) + lane * 0x3030;
+}
+
+// the first byte of "word" goes in out[0], and so on; one store
+static void store8(char *out, uint64_t word)
+{
+    int i;
+
+    for (i = 0; i < 8; i++)
+        out[i] = word >> ( 8 * i );
+}
+
+// with a blank instead of a leading zero on "a", as "%l" and "%_m" do
+static uint64_t blank_tens(uint64_t pairs, unsigned a)
+{
+    return ( a < 10 ) ? pairs - ( '0' - ' ' ) : pairs;
+}
+
+// "12:34:56" from pairs 24 bits apart, with "sep" for the colons
+static uint64_t divided(uint64_t pairs, char sep)
+{
+    return pairs | (uint64_t) sep << 16 | (uint64_t) sep << 40;
+}
+
+// ".07"
+static void put_hundredths(char *out, int hundredths)
+{
+    out[0] = '.';
+    out[1] = '0' + hundredths / 10;
+    out[2] = '0' + hundredths % 10;
+}
+
+static unsigned hour12(struct tm *dateinfo)
+{
+    return ( dateinfo->tm_hour % 12 ) ? dateinfo->tm_hour % 12 : 12;
+}
+
+static char *ampm(struct tm *dateinfo)
+{
+    return ( dateinfo->tm_hour < 12 ) ? " AM" : " PM";
+}
+
+// the year as "%y" has it
+static unsigned year2(struct tm *dateinfo)
+{
+    return ( dateinfo->tm_year % 100 + 100 ) % 100;
+}
+
+// "14:31:25 24"
+static void format_24(char *out, struct tm *dateinfo, int hundredths)
+{
+    store8(out, divided(ascii_pairs(dateinfo->tm_hour, dateinfo->tm_min,
+                                    dateinfo->tm_sec, 24), ':'));
+    memcpy(out + 8, " 24", 4);
+}
+
+// " 4:21:35 PM" (no leading zero on hour!)
+static void format_ampm(char *out, struct tm *dateinfo, int hundredths)
+{
+    unsigned hour = hour12(dateinfo);
+
+    store8(out, divided(blank_tens(ascii_pairs(hour, dateinfo->tm_min,
+                                               dateinfo->tm_sec, 24), hour),
+                        ':'));
+    memcpy(out + 8, ampm(dateinfo), 4);
+}
+
+// "14:31:25.07 24"
+static void format_hires_24(char *out, struct tm *dateinfo, int hundredths)
+{
+    format_24(out, dateinfo, hundredths);
+    put_hundredths(out + 8, hundredths);
+    memcpy(out + 11, " 24", 4);
+}
+
+// " 4:21:35.07 PM"
+static void format_hires_ampm(char *out, struct tm *dateinfo, int hundredths)
+{
+    format_ampm(out, dateinfo, hundredths);
+    put_hundredths(out + 8, hundredths);
+    memcpy(out + 11, ampm(dateinfo), 4);
+}
+
+// the year as "%Y" has it, with no padding; returns its length
+static int put_year(char *out, struct tm *dateinfo)
+{
+    long long          year = dateinfo->tm_year + 1900LL;
+    unsigned long long left = ( year < 0 ) ? -year : year;
+    char               digits[20];
+    int                n = 0, len = 0;
+
+    do {
+        digits[n++] = '0' + left % 10;
+        left /= 10;
+    } while ( left );
+    if ( year < 0 )
+        out[len++] = '-';
+    while ( n )
+        out[len++] = digits[--n];
+    return len;
+}
+
+// "3/17/2012 dt" (no leading zero on month!)
+static void format_date(char *out, struct tm *dateinfo, int hundredths)
+{
+    unsigned month = dateinfo->tm_mon + 1;
+    unsigned day = dateinfo->tm_mday;
+
+    if ( month >= 10 )
+        *out++ = '0' + month / 10;
+    *out++ = '0' + month % 10;
+    *out++ = '/';
+    *out++ = '0' + day / 10;
+    *out++ = '0' + day % 10;
+    *out++ = '/';
+    out += put_year(out, dateinfo);
+    memcpy(out, " dt", 4);
+}
+
+/* Without dividers the pairs are 16 bits apart, and the two bytes
+ * after them are zero, so store8() ends the string too.
+ */
+
+// "143125"
+static void format_plain_24(char *out, struct tm *dateinfo, int hundredths)
+{
+    store8(out, ascii_pairs(dateinfo->tm_hour, dateinfo->tm_min,
+                            dateinfo->tm_sec, 16));
+}
+
+// " 42135"
+static void format_plain_ampm(char *out, struct tm *dateinfo, int hundredths)
+{
+    unsigned hour = hour12(dateinfo);
+
+    store8(out, blank_tens(ascii_pairs(hour, dateinfo->tm_min,
+                                       dateinfo->tm_sec, 16), hour));
+}
+
+// "312507": minutes, seconds and hundredths
+static void format_plain_hires(char *out, struct tm *dateinfo, int hundredths)
+{
+    store8(out, ascii_pairs(dateinfo->tm_min, dateinfo->tm_sec,
+                            hundredths, 16));
+}
+
+// " 31712d": the LEDs have six digits, so the month gets a blank
+// instead and the year is cut to two
+static void format_plain_date(char *out, struct tm *dateinfo, int hundredths)
+{
+    unsigned month = dateinfo->tm_mon + 1;
+
+    store8(out, blank_tens(ascii_pairs(month, dateinfo->tm_mday,
+                                       year2(dateinfo), 16), month)
+                | (uint64_t) 'd' << 48);
+}
+
+/* The formatters for each combination of the AMPM, HIRES and DATE
+ * bits, without and with dividers.  Date mode shows the date whatever
+ * the other bits say.
+ */
+static const formatter formatters[8][2] = {
+    [0]                                 = { format_plain_24, format_24 },
+    [AMPM_MODE]                         = { format_plain_ampm, format_ampm },
+    [HIRES_MODE]                        = { format_plain_hires,
+                                            format_hires_24 },
+    [HIRES_MODE|AMPM_MODE]              = { format_plain_hires,
+                                            format_hires_ampm },
+    [DATE_MODE]                         = { format_plain_date, format_date },
+    [DATE_MODE|AMPM_MODE]               = { format_plain_date, format_date },
+    [DATE_MODE|HIRES_MODE]              = { format_plain_date, format_date },
+    [DATE_MODE|HIRES_MODE|AMPM_MODE]    = { format_plain_date, format_date },
+};
+
+
+clockcore *clockcore_new(void)
+{
+    clockcore *c = calloc(1, sizeof(*c));
+    int        i;
+
+    if ( c == NULL )
+        return NULL;
+    for (i = 0; i < FRAME_CACHE; i++)
+        c->frames[i].when = NO_FRAME;
+    set_view_properties_r(c, 0);
+    return c;
+}
+
+void clockcore_free(clockcore *c)
+{
+    free(c);
+}
+
+void set_view_properties_r(clockcore *c, int viewbits)
+{
+    c->view_props = viewbits;
+    c->format = formatters[viewbits & ( AMPM_MODE | HIRES_MODE | DATE_MODE )];
+}
+
+int get_view_properties_r(clockcore *c)
+{
+    return c->view_props;
+}
+
+void set_hundredths_r(clockcore *c, int h)
+{
+    c->hundredths = h;
+}
+
+void set_offset_r(clockcore *c, int offset)
+{
+    c->offset = offset;
+}
+
+int get_offset_r(clockcore *c)
+{
+    return c->offset;
+}
+
+void set_zone_r(clockcore *c, zone *z)
+{
+    c->zone = z;
+    c->minute_valid = 0;
+}
+
+zone *get_zone_r(clockcore *c)
+{
+    return c->zone;
+}
+
+void set_mode_end_r(clockcore *c, int modes, time_t end)
+{
+    if ( modes & DATE_MODE )
+        c->date_mode_end = end;
+    if ( modes & TEST_MODE )
+        c->test_mode_end = end;
+}
+
+/* Within a minute only the seconds change, and time zone and daylight
+ * saving changes happen on minute boundaries, so the zone is only
+ * looked up once a minute; the rest of the time it's an assignment.
+ */
+struct tm *time_in_zone_r(clockcore *c, time_t t, struct tm *dateinfo)
+{
+    t += c->offset;
+
+    if ( ! c->minute_valid || t < c->minute_start
+         || t >= c->minute_start + 60 ) {
+        if ( c->zone != NULL )
+            zone_time(c->zone, t, &c->minute);
+        else
+            localtime_r(&t, &c->minute);
+        c->minute_start = t - c->minute.tm_sec;
+        c->minute_valid = 1;
+    }
+
+    *dateinfo = c->minute;
+    dateinfo->tm_sec = (int) ( t - c->minute_start );
+    return dateinfo;
+}
+
+int process_key_r(clockcore *c, int key, time_t now)
+{
+    int view_props = c->view_props;
+
+    switch ( key ) {
+        case '2':
+            view_props &= ~AMPM_MODE;
+            break;
+        case 'a':
+            view_props |= AMPM_MODE;
+            break;
+        case 'd':
+            view_props |= DATE_MODE;
+            c->date_mode_end = now + MODE_SECONDS;
+            break;
+        case 't':
+            view_props |= TEST_MODE;
+            c->test_mode_end = now + MODE_SECONDS;
+            break;
+        default:
+            return 0;
+    }
+
+    set_view_properties_r(c, view_props);
+    return 1;
+}
+
+struct tm *new_time_r(clockcore *c, time_t now, int hundredths,
+                      struct tm *dateinfo)
+{
+    int view_props = c->view_props;
+
+    if ( now > c->date_mode_end )
+        view_props &= ~DATE_MODE;
+    if ( now > c->test_mode_end )
+        view_props &= ~TEST_MODE;
+    if ( view_props != c->view_props )
+        set_view_properties_r(c, view_props);
+
+    c->hundredths = hundredths;
+    return time_in_zone_r(c, now, dateinfo);
+}
+
+// make_timestring_r
+// puts a string formatted from the "dateinfo" object in "buffer":
+//   date mode:  "3/17/2012 dt", or " 31712d" without dividers
+//   am/pm:      "11:13:52 AM" or " 4:21:35 PM", or "111352" / " 42135"
+//   24 hour:    "14:31:25 24", or "143125"
+//   hires mode: "14:31:25.07 24" or " 4:21:35.07 PM"; without dividers,
+//               minutes, seconds and hundredths, such as "312507"
+// The same strings strftime(3) would make with "%-m/%d/%Y dt" (or
+// "%_m%d%yd" without dividers), "%l:%M:%S %p" and so on, in the C
+// locale.
+char *make_timestring_r(clockcore *c, struct tm *dateinfo, int dividers,
+                        char *buffer)
+{
+    c->format[dividers != 0](buffer, dateinfo, c->hundredths);
+    return buffer;
+}
+
+/* Segment patterns for every character we put in a format string,
+ * indexed by the character itself.  Anything not listed stays dark.
+ * See LED-layout.txt for which bit is which segment.
+ */
+static const unsigned char glyph[256] = {
+    [' '] = 0x00,
+    ['0'] = 0x77, //0111 0111
+    ['1'] = 0x24, //0010 0100
+    ['2'] = 0x5d, //0101 1101
+    ['3'] = 0x6d, //0110 1101
+    ['4'] = 0x2e, //0010 1110
+    ['5'] = 0x6b, //0110 1011
+    ['6'] = 0x7b, //0111 1011
+    ['7'] = 0x25, //0010 0101
+    ['8'] = 0x7f, //0111 1111
+    ['9'] = 0x6f, //0110 1111
+    ['a'] = 0x3f, //0011 1111
+    ['p'] = 0x1f, //0001 1111
+    ['d'] = 0x7c, //0111 1100
+    ['t'] = 0x5a, //0101 1010
+};
+
+unsigned char led_glyph(char c)
+{
+    return glyph[(unsigned char) c];
+}
+
+char led_char(unsigned char bits)
+{
+    int c;
+
+    bits &= 0x7f;   // the decimal point isn't part of the character
+    if ( bits == 0 )
+        return ' ';
+    for (c = 0; c < 256; c++) {
+        if ( glyph[c] == bits )
+            return c;
+    }
+    return '?';
+}
+
+void frame_title(char *title, char *text)
+{
+    size_t len = strlen(text);
+
+    if ( len > 78 )
+        len = 78;
+    memset(title, '-', 78);
+    memcpy(title + (78 - len) / 2, text, len);
+    title[78] = '\0';
+}
+
+
+/* The cache key for a frame: every field of the time that the frame
+ * shows, packed, or NO_FRAME if one is out of the range a clock face
+ * uses (then the frame isn't cached at all).  Only the last two digits
+ * of the year ever show, so only they go in.
+ */
+static uint64_t frame_key(struct tm *dateinfo, int hundredths)
+{
+    if ( dateinfo->tm_mon < 0 || dateinfo->tm_mon > 11
+         || dateinfo->tm_mday < 0 || dateinfo->tm_mday > 31
+         || dateinfo->tm_hour < 0 || dateinfo->tm_hour > 99
+         || dateinfo->tm_min < 0 || dateinfo->tm_min > 59
+         || dateinfo->tm_sec < 0 || dateinfo->tm_sec > 60
+         || hundredths < 0 || hundredths > 99 )
+        return NO_FRAME;
+
+    return ( ( ( ( ( (uint64_t) year2(dateinfo) * 12 + dateinfo->tm_mon )
+                   * 32 + dateinfo->tm_mday ) * 100 + dateinfo->tm_hour )
+               * 60 + dateinfo->tm_min ) * 61 + dateinfo->tm_sec ) * 100
+           + hundredths;
+}
+
+// encode_led_r
+// turns the whole frame for "dateinfo" into LED bits: the time is
+// formatted once, each of the six digits is one table lookup, and
+// then slot 7 gets the indicators and colons.
+void encode_led_r(clockcore *c, struct tm *dateinfo, unsigned char *where)
+{
+    unsigned char timestring[CLOCKCORE_TIMESTR];
+    struct frame *f;
+    uint64_t when;
+    int   view_props = c->view_props;
+    int   props = view_props & (AMPM_MODE | HIRES_MODE | DATE_MODE
+                                | ALARM_MODE);
+    unsigned char extra;
+    int i;
+
+    when = frame_key(dateinfo, ( props & HIRES_MODE ) ? c->hundredths : 0);
+    f = &c->frames[( when + props ) % FRAME_CACHE];
+    if ( when != NO_FRAME && f->when == when && f->props == props ) {
+        memcpy(where, f->bits, sizeof(f->bits));
+        return;
+    }
+
+    make_timestring_r(c, dateinfo, 0, (char *) timestring);
+    for (i = 0; i < 6 && timestring[i] != '\0'; i++)
+        where[i] = glyph[timestring[i]];
+    for ( ; i < 6; i++)
+        where[i] = 0x00;
+
+    if ( view_props & DATE_MODE ) {
+        extra = 0x08;                      // just the Date indicator
+    } else if ( view_props & HIRES_MODE ) {
+        // MM:SS.cc -- the left colon, and the decimal point on digit 3
+        extra = 0xc0;
+        if ( view_props & AMPM_MODE )
+            extra |= ( dateinfo->tm_hour >= 12 ) ? 0x02 : 0x01;
+        else
+            extra |= 0x04;
+        where[3] |= 0x80;
+    } else if ( view_props & AMPM_MODE ) {
+        extra = 0xf0;                      // colons stay on
+        extra |= ( dateinfo->tm_hour >= 12 ) ? 0x02 : 0x01;
+    } else {
+        extra = 0x04;                      // 24H indicator
+        if ( dateinfo->tm_sec % 2 == 0 )
+            extra |= 0xf0;                 // colons blink
+    }
+    // an alarm flashes all four indicators, once a second
+    if ( view_props & ALARM_MODE ) {
+        if ( dateinfo->tm_sec % 2 == 0 )
+            extra |= 0x0f;
+        else
+            extra &= ~0x0f;
+    }
+    where[7] = extra;
+
+    if ( when == NO_FRAME )
+        return;
+    f->when = when;
+    f->props = props;
+    memcpy(f->bits, where, sizeof(f->bits));
+}
+
@@ -0,0 +1,107 @@
+/* clockcore.h -- the clock's formatting, for other programs
+ *
+ * libclockcore.a turns the time into what a clock face shows, the
+ * text and the LED frame, without the terminal, the event loop or any
+ * of the clock's globals: a "clockcore" is one clock, with its own
+ * view properties, offset, time zone and mode timeouts, and every
+ * function takes the one it works on.  Different clocks can be used
+ * on different threads at once; one clock belongs to one thread at a
+ * time.
+ *
+ * The program using it reads the clock and the keys, and hands them
+ * over with new_time_r() and process_key_r(); in the clock that's the
+ * controller (clock.c), with one clockcore for each face.
+ *
+ * Build it with "make libclockcore.a".  The clock program itself
+ * formats through the same code (see view.c).
+ */
+
+#include <time.h>
+
+/* VIEW OPTIONS
+ *
+ * AMPM (default is 24-hour) --+
+ * hundredths ---------------+ |
+ * date -------------------+ | |
+ * LED mode--------------+ | | |
+ *                       | | | |
+ * test -----------+     | | | |
+ * alarm --------+ |     | | | |
+ *               | |     | | | |
+ *               V V     V V V V
+ *           0 0 0 0     0 0 0 0
+ */
+#define  AMPM_MODE  0x01
+#define  HIRES_MODE 0x02
+#define  DATE_MODE  0x04
+#define  LED_MODE   0x08
+#define  TEST_MODE  0x10
+#define  ALARM_MODE 0x20
+
+#define CLOCKCORE_TIMESTR 40     // room for any string it makes
+#define MODE_SECONDS      5      // how long date and test mode stay on
+
+/* Named time zones, read from the zoneinfo files; see zoneinfo.c.
+ * A zone is loaded once and kept, and any number of clocks can share it.
+ */
+typedef struct zone zone;
+zone *load_zone(char *);           // NULL if there's no such zone
+char *zone_name(zone *);
+void  zone_time(zone *, time_t, struct tm *);
+
+typedef struct clockcore clockcore;
+
+// 24-hour time, no offset, the TZ zone; NULL if out of memory
+clockcore *clockcore_new(void);
+void       clockcore_free(clockcore *);
+
+void set_view_properties_r(clockcore *, int);
+int  get_view_properties_r(clockcore *);
+void set_hundredths_r(clockcore *, int);   // for HIRES_MODE
+
+void  set_offset_r(clockcore *, int);      // seconds ahead of the real time
+int   get_offset_r(clockcore *);
+void  set_zone_r(clockcore *, zone *);     // NULL for the TZ variable
+zone *get_zone_r(clockcore *);
+
+// when DATE_MODE or TEST_MODE (the bits in "modes") goes off again
+void set_mode_end_r(clockcore *, int modes, time_t);
+
+/* The time the clock shows at "t": with its offset, in its zone.  It
+ * goes in "dateinfo", which is returned.
+ */
+struct tm *time_in_zone_r(clockcore *, time_t t, struct tm *dateinfo);
+
+/* A key for the clock: '2' for 24-hour time, 'a' for am/pm, and 'd'
+ * or 't' for date or test mode, for MODE_SECONDS after "now".
+ * Returns 0 for any other key, and leaves it to the caller.
+ */
+int process_key_r(clockcore *, int key, time_t now);
+
+/* A new time to show, "hundredths" into second "now": date and test
+ * mode end if their time is up, and "dateinfo" gets the time as
+ * time_in_zone_r() has it.  Returns "dateinfo".
+ */
+struct tm *new_time_r(clockcore *, time_t now, int hundredths,
+                      struct tm *dateinfo);
+
+/* The time as the clock shows it, in "buffer" (CLOCKCORE_TIMESTR
+ * long), which is returned; see make_timestring_r() in clockcore.c.
+ */
+char *make_timestring_r(clockcore *, struct tm *, int dividers, char *buffer);
+
+// all eight LED slots for a time, as in LED-layout.txt
+void  encode_led_r(clockcore *, struct tm *, unsigned char *);
+
+/* The segments a character lights on an LED digit, and back again,
+ * for programs that draw or read the frames themselves: the digits,
+ * blank and the letters a, p, d and t.  led_glyph() gives 0 (dark) for
+ * anything else, and led_char() ignores the decimal point and gives '?'
+ * for segments that aren't a character.
+ */
+unsigned char led_glyph(char);
+char          led_char(unsigned char);
+
+// "text" centered in a 78-character title bar of dashes; "title"
+// needs room for 81
+void frame_title(char *title, char *text);
@@ -0,0 +1,505 @@
+/* clocktest.c -- checks of the clock's formatter and LED encoder
+ *
+ * "make test" builds this against libclockcore.a and runs it.  It
+ * checks make_timestring_r() and encode_led_r() two ways:
+ *
+ *   - a table of times whose strings and LED bytes were worked out by
+ *     hand, from the comments in clockcore.c and LED-layout.txt;
+ *   - every second of the day, every hundredth, on days picked to be
+ *     awkward, and every date from 1900 to 2099, in every combination
+ *     of the AMPM, HIRES, DATE and ALARM bits, against a reference
+ *     written the slow and obvious way.
+ *
+ * It also checks the mode keys' timeouts, the time a clock shows
+ * with an offset and a zone against the C library's, and the glyph
+ * and title helpers that ledwatch and ledwrite use.
+ *
+ * Each frame is encoded twice, so a frame that comes out of the
+ * encoder's cache is checked as well as one that doesn't.  The first
+ * few differences are printed, and it exits 1 if there are any, so
+ * make stops.
+ *
+ * Usage: clocktest
+ */
+
+#include "clockcore.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+static clockcore *core;
+static long       wrong = 0;
+
+// "ampm+date" and so on; "24h" when nothing is set
+static char *props_name(int props)
+{
+    static char name[40];
+
+    name[0] = '\0';
+    strcat(name, ( props & AMPM_MODE ) ? "ampm" : "24h");
+    if ( props & HIRES_MODE ) strcat(name, "+hires");
+    if ( props & DATE_MODE ) strcat(name, "+date");
+    if ( props & ALARM_MODE ) strcat(name, "+alarm");
+    return name;
+}
+
+static void report(struct tm *tm, int props, int cc, char *what,
+                   char *got, char *want)
+{
+    if ( wrong++ >= 10 )
+        return;
+    fprintf(stderr, "%04d-%02d-%02d %02d:%02d:%02d.%02d %-18s %-10s "
+                    "got \"%s\", want \"%s\"\n",
+            tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday, tm->tm_hour,
+            tm->tm_min, tm->tm_sec, cc, props_name(props), what, got, want);
+}
+
+static char *frame_text(unsigned char *bits)
+{
+    static char text[2][40];
+    static int  which = 0;
+    int         i;
+
+    which = !which;
+    for (i = 0; i < 8; i++)
+        sprintf(text[which] + 3 * i, "%02x ", bits[i]);
+    text[which][23] = '\0';
+    return text[which];
+}
+
+/* Both strings and the frame for one time, compared with what they
+ * should be.  The frame is encoded twice: the second one comes from
+ * the cache.  Digit 6 is reserved, so it isn't compared.
+ */
+static void check(struct tm *tm, int props, int cc, char *want_plain,
+                  char *want_divided, unsigned char *want_bits)
+{
+    char          got[CLOCKCORE_TIMESTR];
+    unsigned char got_bits[8];
+    int           pass;
+
+    set_view_properties_r(core, props);
+    set_hundredths_r(core, cc);
+
+    make_timestring_r(core, tm, 0, got);
+    if ( strcmp(got, want_plain) != 0 )
+        report(tm, props, cc, "string", got, want_plain);
+    make_timestring_r(core, tm, 1, got);
+    if ( strcmp(got, want_divided) != 0 )
+        report(tm, props, cc, "string/d", got, want_divided);
+
+    for (pass = 0; pass < 2; pass++) {
+        memset(got_bits, 0, sizeof(got_bits));
+        encode_led_r(core, tm, got_bits);
+        got_bits[6] = want_bits[6];
+        if ( memcmp(got_bits, want_bits, sizeof(got_bits)) != 0 )
+            report(tm, props, cc, pass ? "frame/c" : "frame",
+                   frame_text(got_bits), frame_text(want_bits));
+    }
+}
+
+
+/* KNOWN TIMES
+ *
+ * Worked out by hand.  Segment patterns are in LED-layout.txt; slot 7
+ * has the indicators (AM 01, PM 02, 24H 04, Date 08) and the colons'
+ * dots (f0 for both colons, c0 for the left one).
+ */
+static const struct known {
+    int           year, mon, mday, hour, min, sec, cc;
+    int           props;
+    char         *plain, *divided;
+    unsigned char bits[8];
+} known[] = {
+    { 2020,  9, 15, 13,  5,  9, 42, 0,
+      "130509", "13:05:09 24",
+      { 0x24, 0x6d, 0x77, 0x6b, 0x77, 0x6f, 0, 0x04 } },
+    { 2020,  9, 15, 13,  5, 10, 42, 0,
+      "130510", "13:05:10 24",
+      { 0x24, 0x6d, 0x77, 0x6b, 0x24, 0x77, 0, 0xf4 } },
+    { 2020,  9, 15, 13,  5,  9, 42, AMPM_MODE,
+      " 10509", " 1:05:09 PM",
+      { 0x00, 0x24, 0x77, 0x6b, 0x77, 0x6f, 0, 0xf2 } },
+    { 2020,  9, 15,  0,  0,  0,  0, AMPM_MODE,
+      "120000", "12:00:00 AM",
+      { 0x24, 0x5d, 0x77, 0x77, 0x77, 0x77, 0, 0xf1 } },
+    { 2020,  9, 15, 12,  0,  0,  0, AMPM_MODE,
+      "120000", "12:00:00 PM",
+      { 0x24, 0x5d, 0x77, 0x77, 0x77, 0x77, 0, 0xf2 } },
+    { 2020,  9, 15, 13,  5,  9, 42, HIRES_MODE,
+      "050942", "13:05:09.42 24",
+      { 0x77, 0x6b, 0x77, 0xef, 0x2e, 0x5d, 0, 0xc4 } },
+    { 2020,  9, 15, 13,  5,  9,  7, HIRES_MODE | AMPM_MODE,
+      "050907", " 1:05:09.07 PM",
+      { 0x77, 0x6b, 0x77, 0xef, 0x77, 0x25, 0, 0xc2 } },
+    { 2020,  9, 15, 13,  5,  9, 42, DATE_MODE,
+      " 91520d", "9/15/2020 dt",
+      { 0x00, 0x6f, 0x24, 0x6b, 0x5d, 0x77, 0, 0x08 } },
+    { 1999, 12, 31, 23, 59, 59, 99, DATE_MODE | AMPM_MODE,
+      "123199d", "12/31/1999 dt",
+      { 0x24, 0x5d, 0x6d, 0x24, 0x6f, 0x6f, 0, 0x08 } },
+    { 2000,  2, 29,  0,  0,  0,  0, DATE_MODE,
+      " 22900d", "2/29/2000 dt",
+      { 0x00, 0x5d, 0x5d, 0x6f, 0x77, 0x77, 0, 0x08 } },
+    { 5,     3,  7,  0,  0,  0,  0, DATE_MODE,          // "%Y" doesn't pad
+      " 30705d", "3/07/5 dt",
+      { 0x00, 0x6d, 0x77, 0x25, 0x77, 0x6b, 0, 0x08 } },
+    { 2020,  9, 15, 12,  0,  0,  0, ALARM_MODE,
+      "120000", "12:00:00 24",
+      { 0x24, 0x5d, 0x77, 0x77, 0x77, 0x77, 0, 0xff } },
+    { 2020,  9, 15, 13,  5,  9, 42, ALARM_MODE | AMPM_MODE,
+      " 10509", " 1:05:09 PM",
+      { 0x00, 0x24, 0x77, 0x6b, 0x77, 0x6f, 0, 0xf0 } },
+    // the first and last years a struct tm holds: only the last two
+    // digits show on the LEDs, and the frame cache mustn't overflow
+    // its key
+    { INT_MAX, 1, 1, 0, 0, 0, 99, HIRES_MODE,
+      "000099", "00:00:00.99 24",
+      { 0x77, 0x77, 0x77, 0xf7, 0x6f, 0x6f, 0, 0xc4 } },
+    { INT_MIN + 1900, 12, 31, 0, 0, 0, 0, DATE_MODE,
+      "123152d", "12/31/-2147481748 dt",
+      { 0x24, 0x5d, 0x6d, 0x24, 0x6b, 0x5d, 0, 0x08 } },
+};
+
+#define NKNOWN (sizeof(known) / sizeof(known[0]))
+
+static long check_known(void)
+{
+    struct tm tm;
+    unsigned  i;
+
+    for (i = 0; i < NKNOWN; i++) {
+        memset(&tm, 0, sizeof(tm));
+        tm.tm_year = known[i].year - 1900;
+        tm.tm_mon = known[i].mon - 1;
+        tm.tm_mday = known[i].mday;
+        tm.tm_hour = known[i].hour;
+        tm.tm_min = known[i].min;
+        tm.tm_sec = known[i].sec;
+        check(&tm, known[i].props, known[i].cc, known[i].plain,
+              known[i].divided, (unsigned char *) known[i].bits);
+    }
+    return NKNOWN;
+}
+
+
+/* REFERENCE
+ *
+ * The segment patterns here are spelled out segment by segment
+ * rather than copied from clockcore.c, so a wrong constant there shows.
+ */
+#define SEG_TOP  0x01
+#define SEG_UL   0x02   // upper left
+#define SEG_UR   0x04
+#define SEG_MID  0x08
+#define SEG_LL   0x10
+#define SEG_LR   0x20
+#define SEG_BOT  0x40
+#define SEG_DP   0x80   // decimal point
+
+#define IND_AM   0x01   // slot 7: the indicators ...
+#define IND_PM   0x02
+#define IND_24H  0x04
+#define IND_DATE 0x08
+#define COLON_L  0xc0   // ... and the colons' dots
+#define COLON_R  0x30
+
+static unsigned char ref_segments(char c)
+{
+    switch ( c ) {
+        case '0': return SEG_TOP|SEG_UL|SEG_UR|SEG_LL|SEG_LR|SEG_BOT;
+        case '1': return SEG_UR|SEG_LR;
+        case '2': return SEG_TOP|SEG_UR|SEG_MID|SEG_LL|SEG_BOT;
+        case '3': return SEG_TOP|SEG_UR|SEG_MID|SEG_LR|SEG_BOT;
+        case '4': return SEG_UL|SEG_UR|SEG_MID|SEG_LR;
+        case '5': return SEG_TOP|SEG_UL|SEG_MID|SEG_LR|SEG_BOT;
+        case '6': return SEG_TOP|SEG_UL|SEG_MID|SEG_LL|SEG_LR|SEG_BOT;
+        case '7': return SEG_TOP|SEG_UR|SEG_LR;
+        case '8': return SEG_TOP|SEG_UL|SEG_UR|SEG_MID|SEG_LL|SEG_LR|SEG_BOT;
+        case '9': return SEG_TOP|SEG_UL|SEG_UR|SEG_MID|SEG_LR|SEG_BOT;
+        default:  return 0;   // a blank, or something we never show
+    }
+}
+
+// what make_timestring_r() should say; see the comments in clockcore.c
+static void ref_timestring(char *out, struct tm *tm, int props,
+                           int dividers, int cc)
+{
+    int   h12 = ( tm->tm_hour % 12 ) ? tm->tm_hour % 12 : 12;
+    char *ampm = ( tm->tm_hour < 12 ) ? "AM" : "PM";
+
+    if ( props & DATE_MODE ) {
+        if ( dividers )
+            sprintf(out, "%d/%02d/%lld dt", tm->tm_mon + 1, tm->tm_mday,
+                    tm->tm_year + 1900LL);
+        else
+            sprintf(out, "%2d%02d%02dd", tm->tm_mon + 1, tm->tm_mday,
+                    tm->tm_year % 100);
+    } else if ( props & HIRES_MODE ) {
+        if ( ! dividers )
+            sprintf(out, "%02d%02d%02d", tm->tm_min, tm->tm_sec, cc);
+        else if ( props & AMPM_MODE )
+            sprintf(out, "%2d:%02d:%02d.%02d %s", h12, tm->tm_min,
+                    tm->tm_sec, cc, ampm);
+        else
+            sprintf(out, "%02d:%02d:%02d.%02d 24", tm->tm_hour, tm->tm_min,
+                    tm->tm_sec, cc);
+    } else if ( props & AMPM_MODE ) {
+        if ( dividers )
+            sprintf(out, "%2d:%02d:%02d %s", h12, tm->tm_min, tm->tm_sec, ampm);
+        else
+            sprintf(out, "%2d%02d%02d", h12, tm->tm_min, tm->tm_sec);
+    } else {
+        if ( dividers )
+            sprintf(out, "%02d:%02d:%02d 24", tm->tm_hour, tm->tm_min,
+                    tm->tm_sec);
+        else
+            sprintf(out, "%02d%02d%02d", tm->tm_hour, tm->tm_min, tm->tm_sec);
+    }
+}
+
+// what encode_led_r() should put in the eight slots
+static void ref_frame(unsigned char *out, struct tm *tm, int props, int cc)
+{
+    char text[40];
+    int  i;
+
+    ref_timestring(text, tm, props, 0, cc);
+    for (i = 0; i < 6; i++)
+        out[i] = ref_segments(text[i]);
+    out[6] = 0;
+
+    if ( props & DATE_MODE ) {
+        out[7] = IND_DATE;
+    } else {
+        if ( props & AMPM_MODE )
+            out[7] = ( tm->tm_hour < 12 ) ? IND_AM : IND_PM;
+        else
+            out[7] = IND_24H;
+
+        if ( props & HIRES_MODE ) {         // MM:SS.cc
+            out[7] |= COLON_L;
+            out[3] |= SEG_DP;
+        } else if ( ( props & AMPM_MODE ) || tm->tm_sec % 2 == 0 ) {
+            out[7] |= COLON_L | COLON_R;    // 24-hour colons blink
+        }
+    }
+
+    if ( props & ALARM_MODE ) {
+        out[7] &= ~( IND_AM | IND_PM | IND_24H | IND_DATE );
+        if ( tm->tm_sec % 2 == 0 )
+            out[7] |= IND_AM | IND_PM | IND_24H | IND_DATE;
+    }
+}
+
+#define CHECK_PROPS (AMPM_MODE|HIRES_MODE|DATE_MODE|ALARM_MODE)
+
+// one time in every combination of view properties
+static long check_reference(struct tm *tm, int cc)
+{
+    char          plain[40], divided[40];
+    unsigned char bits[8];
+    int           props;
+    long          checked = 0;
+
+    for (props = 0; props <= CHECK_PROPS; props++) {
+        if ( props & ~CHECK_PROPS )
+            continue;
+        ref_timestring(plain, tm, props, 0, cc);
+        ref_timestring(divided, tm, props, 1, cc);
+        ref_frame(bits, tm, props, cc);
+        check(tm, props, cc, plain, divided, bits);
+        checked++;
+    }
+    return checked;
+}
+
+// every second of some awkward days: one-digit months, leap days, the
+// turn of the century and of 2038
+static long check_days(void)
+{
+    static const struct { int year, mon, mday; } days[] = {
+        { 1970,  1,  1 }, { 1999, 12, 31 }, { 2000,  2, 29 },
+        { 2012,  3, 17 }, { 2020, 10, 31 }, { 2038,  1, 19 },
+    };
+    struct tm tm;
+    long      checked = 0;
+    int       day, second;
+
+    for (day = 0; day < (int) (sizeof(days) / sizeof(days[0])); day++) {
+        for (second = 0; second < 86400; second++) {
+            memset(&tm, 0, sizeof(tm));
+            tm.tm_year = days[day].year - 1900;
+            tm.tm_mon = days[day].mon - 1;
+            tm.tm_mday = days[day].mday;
+            tm.tm_hour = second / 3600;
+            tm.tm_min = second / 60 % 60;
+            tm.tm_sec = second % 60;
+            // every hundredth, many times a day
+            checked += check_reference(&tm, second * 37 % 100);
+        }
+    }
+    return checked;
+}
+
+// every date from 1900 to 2099, at a time that changes with the date
+static long check_dates(void)
+{
+    static const int mdays[] = { 31, 29, 31, 30, 31, 30,
+                                 31, 31, 30, 31, 30, 31 };
+    struct tm tm;
+    long      checked = 0;
+    int       year, mon, mday;
+
+    for (year = 1900; year < 2100; year++) {
+        for (mon = 0; mon < 12; mon++) {
+            for (mday = 1; mday <= mdays[mon]; mday++) {
+                memset(&tm, 0, sizeof(tm));
+                tm.tm_year = year - 1900;
+                tm.tm_mon = mon;
+                tm.tm_mday = mday;
+                tm.tm_hour = ( year + mday ) % 24;
+                tm.tm_min = ( year + mon ) % 60;
+                tm.tm_sec = ( mon * 31 + mday ) % 60;
+                checked += check_reference(&tm, year % 100);
+            }
+        }
+    }
+    return checked;
+}
+
+
+/* KEYS, TICKS AND ZONES
+ *
+ * The mode keys and their timeouts, and time_in_zone_r() against
+ * localtime_r() (and gmtime_r(), for a zone), minute after minute, so
+ * the minute it remembers is checked as well.
+ */
+static void check_failed(char *what, long long t)
+{
+    if ( wrong++ < 10 )
+        fprintf(stderr, "%s wrong at %lld\n", what, t);
+}
+
+static int same_tm(struct tm *a, struct tm *b)
+{
+    return a->tm_year == b->tm_year && a->tm_mon == b->tm_mon
+           && a->tm_mday == b->tm_mday && a->tm_hour == b->tm_hour
+           && a->tm_min == b->tm_min && a->tm_sec == b->tm_sec
+           && a->tm_wday == b->tm_wday && a->tm_yday == b->tm_yday
+           && a->tm_isdst == b->tm_isdst;
+}
+
+static long check_clock(void)
+{
+    clockcore *c = clockcore_new();
+    zone      *utc = load_zone("UTC");
+    struct tm  got, want;
+    time_t     t, base = 1600000000;  // September 2020
+    long       checked = 0;
+
+    if ( c == NULL ) {
+        perror("clockcore_new");
+        exit(1);
+    }
+
+    if ( ! process_key_r(c, 'a', base)
+         || ! ( get_view_properties_r(c) & AMPM_MODE ) )
+        check_failed("key a", base);
+    if ( ! process_key_r(c, '2', base)
+         || ( get_view_properties_r(c) & AMPM_MODE ) )
+        check_failed("key 2", base);
+    if ( process_key_r(c, 'x', base) )
+        check_failed("key x", base);
+    process_key_r(c, 'd', base);
+    process_key_r(c, 't', base + 1);
+    new_time_r(c, base + MODE_SECONDS, 0, &got);
+    if ( ! ( get_view_properties_r(c) & DATE_MODE ) )
+        check_failed("date mode", base + MODE_SECONDS);
+    new_time_r(c, base + MODE_SECONDS + 1, 0, &got);
+    if ( ( get_view_properties_r(c) & DATE_MODE )
+         || ! ( get_view_properties_r(c) & TEST_MODE ) )
+        check_failed("date mode", base + MODE_SECONDS + 1);
+    new_time_r(c, base + MODE_SECONDS + 2, 0, &got);
+    if ( get_view_properties_r(c) & TEST_MODE )
+        check_failed("test mode", base + MODE_SECONDS + 2);
+    checked += 6;
+
+    // forward a second at a time, then back, with an offset
+    set_offset_r(c, -3599);
+    for (t = base - 200; t < base + 200; t++, checked++) {
+        time_t shown = t - 3599;
+
+        localtime_r(&shown, &want);
+        if ( ! same_tm(time_in_zone_r(c, t, &got), &want) )
+            check_failed("local time", t);
+    }
+    for (t = base + 200; t > base - 200; t -= 7, checked++) {
+        time_t shown = t - 3599;
+
+        localtime_r(&shown, &want);
+        if ( ! same_tm(time_in_zone_r(c, t, &got), &want) )
+            check_failed("local time", t);
+    }
+
+    if ( utc != NULL ) {
+        set_zone_r(c, utc);
+        for (t = base - 200; t < base + 200; t++, checked++) {
+            time_t shown = t - 3599;
+
+            gmtime_r(&shown, &want);
+            if ( ! same_tm(time_in_zone_r(c, t, &got), &want) )
+                check_failed("UTC", t);
+        }
+    }
+
+    clockcore_free(c);
+    return checked;
+}
+
+// led_char() undoes led_glyph(), and frame_title() centers its text
+static long check_glyphs(void)
+{
+    static const char shown[] = " 0123456789apdt";
+    char              title[81];
+    int               i;
+
+    for (i = 0; shown[i] != '\0'; i++) {
+        if ( led_char(led_glyph(shown[i])) != shown[i]
+             || led_char(led_glyph(shown[i]) | 0x80) != shown[i] )
+            check_failed("glyph", shown[i]);
+    }
+    if ( led_glyph('x') != 0 || led_char(0x01) != '?' )
+        check_failed("glyph", 'x');
+
+    frame_title(title, "ALARM");
+    if ( strlen(title) != 78 || strncmp(title + 35, "-ALARM-", 7) != 0 )
+        check_failed("title", 0);
+
+    return i + 2;
+}
+
+int main(int argc, char *argv[])
+{
+    long checked = 0;
+
+    core = clockcore_new();
+    if ( core == NULL ) {
+        perror("clockcore_new");
+        exit(1);
+    }
+
+    checked += check_known();
+    checked += check_days();
+    checked += check_dates();
+    checked += check_clock();
+    checked += check_glyphs();
+
+    clockcore_free(core);
+
+    fprintf(stderr, "%s: checked %ld times: %ld wrong\n",
+            argv[0], checked, wrong);
+    return wrong ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+/* events.c -- event loop for the clock project
+ *
+ * Everything the clock reacts to (timer ticks, keystrokes, signals)
+ * shows up as a file descriptor becoming readable.  We watch all of
+ * them with one epoll(7) descriptor and call a handler for each one
+ * that is ready, so all the real work happens in normal context
+ * instead of inside a signal handler.
+ */
+
+#include "clock.h"
+
+#include <sys/epoll.h>
+#include <errno.h>
+
+// one of these for each descriptor we watch
+struct event_source {
+    int            fd;
+    event_handler  handler;
+    struct event_source *next;
+};
+
+static int epoll_fd = -1;
+static struct event_source *sources = NULL;  // so we don't only have
+                                             // epoll's pointers to them
+static void (*batch_done)(void) = NULL;
+
+void add_event_source(int fd, event_handler handler)
+{
+    struct epoll_event   event;
+    struct event_source *source;
+
+    if ( epoll_fd == -1 ) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if ( epoll_fd == -1 ) {
+            perror("Could not create event loop");
+            exit(1);
+        }
+    }
+
+    source = malloc(sizeof(*source));
+    if ( source == NULL ) {
+        perror("Could not add event source");
+        exit(1);
+    }
+    source->fd = fd;
+    source->handler = handler;
+    source->next = sources;
+    sources = source;
+
+    event.events = EPOLLIN;
+    event.data.ptr = source;
+    if ( epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1 ) {
+        perror("Could not watch event source");
+        exit(1);
+    }
+}
+
+/* Call "f" after each batch of handlers has run, before waiting
+ * again.  Work that only needs doing once no matter how many events
+ * came in (like drawing) goes there.
+ */
+void after_events(void (*f)(void))
+{
+    batch_done = f;
+}
+
+/* Wait for something to happen, then handle it.  Never returns;
+ * the clock stops by calling exit() from one of the handlers.
+ */
+void run_event_loop(void)
+{
+    struct epoll_event   events[8];
+    struct event_source *source;
+    int                  ready, i;
+
+    while (1) {
+        ready = epoll_wait(epoll_fd, events, 8, -1);
+        if ( ready == -1 ) {
+            if ( errno == EINTR )
+                continue;
+            perror("Event loop failed");
+            exit(1);
+        }
+
+        for (i = 0; i < ready; i++) {
+            source = events[i].data.ptr;
+            source->handler(source->fd);
+        }
+        if ( batch_done )
+            batch_done();
+    }
+}
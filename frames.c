@@ -0,0 +1,117 @@
+/* frames.c -- deciding when to draw
+ *
+ * Anything that needs the faces drawn again (the timer, a key, the
+ * terminal changing size) asks for a frame instead of drawing right
+ * away.  Once the event loop has handled everything that was ready,
+ * run_frames() draws one frame for all of those requests together.
+ *
+ * With a frame rate limit (-F), frames are also kept at least
+ * 1/fps seconds apart; requests that come in sooner wait for a one-shot
+ * timer and then go out together.  So no matter how fast the keys
+ * come, the terminal never gets more than "fps" frames a second.
+ *
+ * Frames can also be asked for ahead of time with frame_at(), for
+ * things like a stopwatch whose seconds don't start with the clock's.
+ */
+
+#include "clock.h"
+
+#include <sys/timerfd.h>
+#include <stdint.h>
+
+static int       wanted = 0;        // FRAME_ bits asked for since the last one
+static long long frame_ns = 0;      // least time between frames; 0 for no limit
+static long long last_frame = 0;    // monotonic_ns() when we last drew
+static long long due = 0;           // when a frame_at() frame is due; 0 if none
+static int       frame_fd = -1;     // wakes us for the next frame
+static long long frame_fd_armed = 0;  // when it goes off; 0 if it won't
+
+void set_max_fps(int fps)
+{
+    if ( fps < 0 || fps > 1000 ) {
+        fprintf(stderr, "frame rate must be 0 (no limit) to 1000\n");
+        exit(1);
+    }
+    frame_ns = fps ? 1000000000LL / fps : 0;
+}
+
+void request_frame(int why)
+{
+    wanted |= why;
+}
+
+void frame_at(long long when)
+{
+    if ( due == 0 || when < due )
+        due = when;
+}
+
+// the frame timer went off; run_frames() will see it's time
+static void frame_timer_ready(int fd)
+{
+    uint64_t expirations;
+
+    if ( read(fd, &expirations, sizeof(expirations)) == -1 )
+        return;
+    frame_fd_armed = 0;
+}
+
+// wake up by "when" (on the monotonic clock) to draw what's waiting
+static void wait_for_frame(long long when)
+{
+    struct itimerspec deadline = { { 0, 0 }, { 0, 0 } };
+
+    if ( frame_fd == -1 ) {
+        frame_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if ( frame_fd == -1 ) {
+            perror("Could not create frame timer");
+            exit(1);
+        }
+        add_event_source(frame_fd, frame_timer_ready);
+    }
+    if ( frame_fd_armed && frame_fd_armed <= when )
+        return;
+
+    deadline.it_value.tv_sec = when / 1000000000;
+    deadline.it_value.tv_nsec = when % 1000000000;
+    if ( timerfd_settime(frame_fd, TFD_TIMER_ABSTIME, &deadline, NULL) == -1 ) {
+        perror("Could not set frame timer");
+        exit(1);
+    }
+    frame_fd_armed = when;
+}
+
+/* Called after each batch of events.  Draws a frame if one was asked
+ * for and the rate limit allows it, and sets the timer for the next
+ * one that's waiting.
+ */
+void run_frames(void)
+{
+    long long now, next = 0;
+    int       why;
+
+    if ( wanted == 0 && due == 0 )
+        return;
+
+    now = monotonic_ns();
+    if ( due && now >= due ) {
+        wanted |= FRAME_DUE;
+        due = 0;
+    }
+
+    if ( wanted ) {
+        if ( frame_ns && now < last_frame + frame_ns ) {
+            next = last_frame + frame_ns;
+        } else {
+            why = wanted;
+            wanted = 0;
+            last_frame = now;
+            draw_frame(why);   // which may call frame_at()
+        }
+    }
+
+    if ( due && ( next == 0 || due < next ) )
+        next = due;
+    if ( next )
+        wait_for_frame(next);
+}
@@ -0,0 +1,75 @@
+/* keyqueue.c -- keys waiting to be handled
+ *
+ * The driver's keyhandler only puts each key here; the controller
+ * takes them all out after the event loop has read everything that
+ * was ready, applies them, and draws once.  So a burst of keys costs
+ * one frame instead of one frame per key.
+ *
+ * It's a ring with one writer and one reader.  Each end only stores
+ * its own index and publishes it with a release store, so neither
+ * side ever waits for the other and no lock is needed, even if the
+ * keys are someday read on a thread of their own.
+ *
+ * A key that comes when the ring is full is dropped, except a quit:
+ * that waits in a slot of its own and comes out after the ring is
+ * empty, so the clock can always be stopped.
+ */
+
+#include "clock.h"
+
+#include <stdatomic.h>
+
+static struct key_event queue[KEY_QUEUE_SIZE];
+static atomic_uint      head = 0;    // next one to read; only the reader moves it
+static atomic_uint      tail = 0;    // next one to write; only the writer moves it
+static struct key_event quit;        // a quit that came when the ring was full
+static atomic_int       quitting = 0;  // the writer sets it, the reader clears it
+
+// 'q', or the Off button
+int is_quit_key(keybits key)
+{
+    return ( key >> 8 ) == 'q' || key == 0x40;
+}
+
+/* Add a key to the queue.  Returns 0, and drops the key, if the
+ * queue is full and it isn't a quit.
+ */
+int put_key(struct key_event *key)
+{
+    unsigned int t = atomic_load_explicit(&tail, memory_order_relaxed);
+    unsigned int h = atomic_load_explicit(&head, memory_order_acquire);
+
+    if ( t - h == KEY_QUEUE_SIZE ) {
+        if ( ! is_quit_key(key->key) )
+            return 0;
+        // one quit waiting is as good as two
+        if ( ! atomic_load_explicit(&quitting, memory_order_acquire) ) {
+            quit = *key;
+            atomic_store_explicit(&quitting, 1, memory_order_release);
+        }
+        return 1;
+    }
+
+    queue[t % KEY_QUEUE_SIZE] = *key;
+    atomic_store_explicit(&tail, t + 1, memory_order_release);
+    return 1;
+}
+
+/* Take the oldest key off the queue.  Returns 0 if there isn't one. */
+int take_key(struct key_event *key)
+{
+    unsigned int h = atomic_load_explicit(&head, memory_order_relaxed);
+    unsigned int t = atomic_load_explicit(&tail, memory_order_acquire);
+
+    if ( h == t ) {
+        if ( ! atomic_load_explicit(&quitting, memory_order_acquire) )
+            return 0;
+        *key = quit;
+        atomic_store_explicit(&quitting, 0, memory_order_release);
+        return 1;
+    }
+
+    *key = queue[h % KEY_QUEUE_SIZE];
+    atomic_store_explicit(&head, h + 1, memory_order_release);
+    return 1;
+}
@@ -0,0 +1,122 @@
+/* ledlayout.c -- working out where everything on an LED panel goes
+ *
+ * At scale s, a digit is 6s columns by 6s+1 rows: the vertical bars
+ * are s columns thick and the horizontal ones (s+1)/2 rows, which
+ * looks about square in a terminal.  Digits are 9s columns apart,
+ * with another 3s between each pair for the colons.  Below the LEDs
+ * are the same two rows of keys as ever, in a frame that fills the
+ * terminal.
+ *
+ * The scale is the biggest that fits, keeping at least the margins
+ * the 80x24 layout has.
+ */
+
+#include <string.h>
+
+#include "ledlayout.h"
+
+static struct rect rect(int y, int x, int h, int w)
+{
+    struct rect r = { y, x, h, w };
+
+    return r;
+}
+
+// how wide the digits and the indicators are at scale "s"
+static int width(int s, int ndigits)
+{
+    return ( ndigits - 1 ) * 9 * s + ( ( ndigits - 1 ) / 2 ) * 3 * s
+           + 6 * s + 2 * s + 4;
+}
+
+static int fits(int s, int ndigits, int rows, int cols)
+{
+    return width(s, ndigits) + 17 <= cols && 6 * s + 1 + 4 <= rows - 13;
+}
+
+void layout_panel(struct layout *l, int rows, int cols, int ndigits)
+{
+    int s = 1, w, h, thick, high, mid, left, top;
+    int i, row, col;
+
+    if ( ndigits > LAYOUT_DIGITS )
+        ndigits = LAYOUT_DIGITS;
+    while ( s < LAYOUT_MAX_SCALE && fits(s + 1, ndigits, rows, cols) )
+        s++;
+
+    // too small a terminal gets the 80x24 layout, cut off
+    if ( rows < 24 )
+        rows = 24;
+    if ( cols < 80 )
+        cols = 80;
+
+    memset(l, 0, sizeof(*l));
+    l->rows = rows;
+    l->cols = cols;
+    l->scale = s;
+    l->ndigits = ndigits;
+
+    l->divider = rows - 12;
+    l->bottom = rows - 2;
+
+    w = 6 * s;
+    h = 6 * s + 1;
+    thick = s;
+    high = ( s + 1 ) / 2;
+    mid = h / 2;
+
+    // centred, and two columns to the right, as it always was
+    left = ( cols - width(s, ndigits) ) / 2 + 2;
+    top = 1 + ( l->divider - 1 - h ) / 2;
+
+    for (i = 0; i < ndigits; i++) {
+        int x = left + i * 9 * s + ( i / 2 ) * 3 * s;
+
+        l->digit[i] = rect(top, x, h, w + 2 * s);
+        l->segment[i][0] = rect(top, x, high, w);                    // top
+        l->segment[i][1] = rect(top, x, mid + 1, thick);             // UL
+        l->segment[i][2] = rect(top, x + w - thick, mid + 1, thick); // UR
+        l->segment[i][3] = rect(top + mid, x, high, w);              // middle
+        l->segment[i][4] = rect(top + mid, x, h - mid, thick);       // LL
+        l->segment[i][5] = rect(top + mid, x + w - thick, h - mid, thick);
+        l->segment[i][6] = rect(top + h - high, x, high, w);         // bottom
+        l->segment[i][7] = rect(top + h - high, x + w + s, high, thick);
+    }
+
+    // the colons after digits 1 and 3
+    for (i = 0; i < 2 && 2 * i + 1 < ndigits; i++) {
+        int x = l->digit[2 * i + 1].x + w + 2 * s;
+
+        l->dot[2 * i] = rect(top + h / 3, x, high, 2 * s);
+        l->dot[2 * i + 1] = rect(top + 2 * h / 3, x, high, 2 * s);
+    }
+
+    l->indicator[0] = rect(top + mid - 1, 0, 1, 2);   // AM
+    l->indicator[1] = rect(top + mid, 0, 1, 2);       // PM
+    l->indicator[2] = rect(top + mid + 1, 0, 1, 3);   // 24H
+    l->indicator[3] = rect(top + mid + 2, 0, 1, 4);   // Date
+    for (i = 0; i < 4; i++)
+        l->indicator[i].x = l->digit[ndigits - 1].x + w + 2 * s;
+
+    for (row = 0; row < 2; row++) {
+        for (col = 0; col < 5; col++)
+            l->key[row][col] = rect(l->divider + 2 + 4 * row,
+                                    7 + ( cols - 80 ) / 2 + col * 14, 3, 10);
+    }
+}
+
+int layout_key(struct layout *l, int y, int x)
+{
+    struct rect *k;
+    int          row, col;
+
+    for (row = 0; row < 2; row++) {
+        for (col = 0; col < 5; col++) {
+            k = &l->key[row][col];
+            if ( y >= k->y && y < k->y + k->h
+                 && x > k->x && x < k->x + k->w )
+                return ( col << 4 ) + row;
+        }
+    }
+    return -1;
+}
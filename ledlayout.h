@@ -0,0 +1,37 @@
+/* ledlayout.h -- where everything on an LED panel goes
+ *
+ * layout_panel() works out, for a terminal of a given size, where each
+ * digit and each of its segments go, and the colon dots, indicators
+ * and keys.  The driver does this when a panel starts and when its
+ * terminal changes size, and draws every frame from the result, so
+ * nothing on the tick path does any arithmetic about the screen.
+ *
+ * On 80x24 this is the layout the panel always had (see
+ * LED-layout.txt); bigger terminals get bigger digits, centred.
+ */
+
+#define LAYOUT_DIGITS    8   // most digits a layout can place
+#define LAYOUT_MAX_SCALE 8   // so a digit cell is never over 64 columns
+
+struct rect {
+    int y, x;        // top left
+    int h, w;
+};
+
+struct layout {
+    int rows, cols;                        // the terminal it's for
+    int scale;                             // 1 on 80x24
+    int ndigits;
+    struct rect digit[LAYOUT_DIGITS];      // a digit's whole cell
+    struct rect segment[LAYOUT_DIGITS][8]; // one per bit, as in LED-layout.txt
+    struct rect dot[4];                    // colon dots: UL, LL, UR, LR
+    struct rect indicator[4];              // AM, PM, 24H and Date
+    int divider;                           // the line above the keys
+    int bottom;                            // the frame's bottom line
+    struct rect key[2][5];                 // the two rows of keys
+};
+
+void layout_panel(struct layout *, int rows, int cols, int ndigits);
+
+// the keybits for a click at (y, x), or -1 if it missed the keys
+int  layout_key(struct layout *, int y, int x);
@@ -0,0 +1,49 @@
+/* ledshm.h -- layout of the shared frame buffer
+ *
+ * With "clock -M name", the LED driver copies every frame it draws into
+ * the POSIX shared memory object "name" (see shm_overview(7)), so other
+ * programs can watch the panels without asking the clock for anything.
+ * ledwatch.c is one of them.
+ *
+ * Each panel has a sequence number that its writer makes odd before it
+ * changes the panel and even again afterwards.  A reader copies the
+ * panel out, and if the number was odd or changed along the way, it
+ * reads again; see read_panel() in ledwatch.c.
+ *
+ * Another program can draw on a panel instead of the clock: it puts
+ * its process ID in "owner" (if that was 0), and from then on it
+ * writes the panel's frames and the clock draws what it finds there;
+ * ledwrite.c does this.  Both writers make the sequence number odd
+ * with a compare-and-swap from an even one, so it is a lock as well,
+ * and the clock only writes a panel after it has that lock and seen
+ * "owner" is 0.  When the owner is done it sets "owner" back to 0;
+ * if it dies first, the clock notices and takes the panel back.
+ *
+ * The clock writing the buffer keeps its process ID in "clock".  A
+ * second clock given the same name won't start while that one is
+ * running, and takes over a buffer whose clock has died.
+ */
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define LEDSHM_MAGIC  0x4c454433   // "LED3"
+#define LEDSHM_PANELS 256
+
+struct ledshm_panel {
+    _Atomic uint32_t seq;          // odd while someone is writing
+    _Atomic uint32_t owner;        // who draws here instead; 0 for the clock
+    uint32_t         frames;       // frames drawn on this panel
+    char             name[64];     // its terminal; "" for the clock's own
+    unsigned char    digits[8];    // as in LED-layout.txt
+    char             title[81];
+    char             keys[5][7];   // the second row of keys
+};
+
+struct ledshm {
+    uint32_t            magic;
+    uint32_t            npanels;      // how many of "panel" are in use
+    _Atomic uint32_t    generation;   // goes up with every frame on any panel
+    _Atomic uint32_t    clock;        // process ID of the clock writing it
+    struct ledshm_panel panel[LEDSHM_PANELS];
+};
@@ -0,0 +1,80 @@
+/* ledstream.c -- turn the clock's binary frame stream back into text
+ *
+ * "CLOCKLEDBACKEND=stream clock -l | ledstream" shows one line per
+ * record: when it was drawn, the panel, which digits changed, and the
+ * 8 digit bytes.  The record layout is described with the stream
+ * backend in LEDisplay.c.
+ *
+ * With -c, digits that didn't change are shown as "--", which makes
+ * it easy to see what each frame really did.
+ *
+ * Usage: ledstream [-c] [file]
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define STREAM_RECORD 16
+
+static void print_record(unsigned char *r, int changes_only)
+{
+    unsigned long seconds;
+    unsigned int  msec, changed;
+    int           i;
+
+    seconds = r[0] | r[1] << 8 | r[2] << 16 | (unsigned long) r[3] << 24;
+    msec = r[4] | r[5] << 8;
+    changed = r[7];
+
+    printf("%lu.%03u panel %u changed %02x  ", seconds, msec, r[6], changed);
+    for (i = 0; i < 8; i++) {
+        if ( changes_only && ! ( changed & (1 << i) ) )
+            printf(" --");
+        else
+            printf(" %02x", r[8 + i]);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned char buffer[256 * STREAM_RECORD];
+    ssize_t       got;
+    size_t        have = 0, i;
+    int           changes_only = 0;
+    int           letter;
+    int           in = STDIN_FILENO;
+
+    while ( ( letter = getopt(argc, argv, "c")) != -1 ) {
+        switch (letter) {
+            case 'c':  changes_only = 1;  break;
+            default:
+                fprintf(stderr, "Usage: %s [-c] [file]\n", argv[0]);
+                exit(1);
+        }
+    }
+    if ( optind < argc && ( in = open(argv[optind], O_RDONLY) ) == -1 ) {
+        perror(argv[optind]);
+        exit(1);
+    }
+
+    /* Print whatever whole records have come in, as soon as they come
+     * (the clock writes a frame at a time), and keep any part of one.
+     */
+    while ( ( got = read(in, buffer + have, sizeof(buffer) - have) ) > 0 ) {
+        have += got;
+        for (i = 0; i + STREAM_RECORD <= have; i += STREAM_RECORD)
+            print_record(buffer + i, changes_only);
+        memmove(buffer, buffer + i, have - i);
+        have -= i;
+        fflush(stdout);
+    }
+    if ( got == -1 ) {
+        perror("Could not read frames");
+        exit(1);
+    }
+    return 0;
+}
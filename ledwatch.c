@@ -0,0 +1,126 @@
+/* ledwatch.c -- watch a clock's panels through its shared frame buffer
+ *
+ * Run the clock with "-M name", then "ledwatch name" prints a line
+ * every time a panel shows a new frame: the panel, the digits as the
+ * clock would draw them, the raw bits, and the title.  "-1" prints
+ * each panel once and stops, for scripts and tests.
+ *
+ * We only ever read the shared memory, so watching costs the clock
+ * nothing.  See ledshm.h for the layout.
+ *
+ * Usage: ledwatch [-1] [-i msec] name
+ */
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ledshm.h"
+#include "clockcore.h"
+
+/* Copy panel "p" out of shared memory.  If the clock was writing it
+ * (the sequence number was odd, or moved while we copied), try again.
+ */
+static void read_panel(struct ledshm_panel *p, struct ledshm_panel *copy)
+{
+    uint32_t before, after;
+
+    do {
+        before = atomic_load_explicit(&p->seq, memory_order_acquire);
+        memcpy((char *) copy + sizeof(copy->seq),
+               (char *) p + sizeof(p->seq), sizeof(*p) - sizeof(p->seq));
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&p->seq, memory_order_relaxed);
+    } while ( ( before & 1 ) || before != after );
+
+    atomic_store_explicit(&copy->seq, after, memory_order_relaxed);
+}
+
+static void print_panel(struct ledshm_panel *p)
+{
+    char text[16];
+    int  n = 0, i;
+
+    for (i = 0; i < 6; i++) {
+        text[n++] = led_char(p->digits[i]);
+        if ( p->digits[i] & 0x80 )
+            text[n++] = '.';
+    }
+    text[n] = '\0';
+
+    printf("%-12s %-8s ", p->name[0] ? p->name : "(main)", text);
+    for (i = 0; i < 8; i++) {
+        if ( i != 6 )   // digit 6 is reserved
+            printf(" %02x", p->digits[i]);
+    }
+    printf("  %.78s\n", p->title);
+}
+
+int main(int argc, char *argv[])
+{
+    struct ledshm       *shared;
+    struct ledshm_panel  copy;
+    uint32_t             seen[LEDSHM_PANELS] = { 0 };
+    uint32_t             generation = 0;
+    struct timespec      pause = { 0, 10000000 };
+    int                  once = 0;
+    int                  letter, fd, i;
+
+    while ( ( letter = getopt(argc, argv, "1i:")) != -1 ) {
+        switch (letter) {
+            case '1':  once = 1;  break;
+            case 'i':  pause.tv_sec = atoi(optarg) / 1000;
+                       pause.tv_nsec = atoi(optarg) % 1000 * 1000000L;
+                       break;
+            default:
+                fprintf(stderr, "Usage: %s [-1] [-i msec] name\n", argv[0]);
+                exit(1);
+        }
+    }
+    if ( optind != argc - 1 ) {
+        fprintf(stderr, "Usage: %s [-1] [-i msec] name\n", argv[0]);
+        exit(1);
+    }
+
+    fd = shm_open(argv[optind], O_RDONLY, 0);
+    if ( fd == -1 ) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    shared = mmap(NULL, sizeof(*shared), PROT_READ, MAP_SHARED, fd, 0);
+    if ( shared == MAP_FAILED ) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    close(fd);
+
+    if ( shared->magic != LEDSHM_MAGIC ) {
+        fprintf(stderr, "%s is not a clock's frame buffer\n", argv[optind]);
+        exit(1);
+    }
+
+    while (1) {
+        // nothing new anywhere: one load, then sleep
+        if ( atomic_load_explicit(&shared->generation, memory_order_acquire)
+             != generation || once ) {
+            generation = atomic_load_explicit(&shared->generation,
+                                              memory_order_acquire);
+            for (i = 0; i < shared->npanels && i < LEDSHM_PANELS; i++) {
+                read_panel(&shared->panel[i], &copy);
+                if ( copy.frames == seen[i] && ! once )
+                    continue;
+                seen[i] = copy.frames;
+                print_panel(&copy);
+            }
+            fflush(stdout);
+        }
+        if ( once )
+            break;
+        nanosleep(&pause, NULL);
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+/* ledwrite.c -- draw on one of a clock's panels through its shared
+ * frame buffer
+ *
+ * Run the clock with "-M name", then "ledwrite name" takes over its
+ * own panel ("-p n" for the nth one, as ledwatch lists them) and
+ * shows each line of standard input on it until the input ends or
+ * it's interrupted; then the clock gets the panel back.
+ *
+ * A line is up to six characters, one to a digit: digits, blanks and
+ * the letters a, p, d and t.  A '.' lights the decimal point of the
+ * digit before it, and each ':' lights a colon, left then right, so
+ * "12:34:56" looks like the clock.  "-t text" puts text in the title.
+ * A line shows on the panel at the clock's next frame.
+ *
+ * See ledshm.h for how the panel is handed over.
+ *
+ * Usage: ledwrite [-p panel] [-t title] name
+ */
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ledshm.h"
+#include "clockcore.h"
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void interrupt(int sig)
+{
+    interrupted = 1;
+}
+
+// the eight digit bytes for a line of input
+static void encode_line(char *line, unsigned char *digits)
+{
+    int n = 0, colons = 0;
+
+    memset(digits, 0, 8);
+    for ( ; *line != '\0' && *line != '\n'; line++) {
+        if ( *line == '.' && n > 0 )
+            digits[n - 1] |= 0x80;
+        else if ( *line == ':' && colons < 2 )
+            digits[7] |= colons++ ? 0x30 : 0xc0;
+        else if ( n < 6 )
+            digits[n++] = led_glyph(*line);
+    }
+}
+
+/* Put a frame in the panel, inside its sequence number.  The clock
+ * holds it for a few memcpy()s at most, so we wait for it.
+ */
+static void write_panel(struct ledshm *shared, struct ledshm_panel *p,
+                        unsigned char *digits, char *title)
+{
+    uint32_t seq;
+
+    while (1) {
+        seq = atomic_load_explicit(&p->seq, memory_order_relaxed);
+        if ( ! ( seq & 1 )
+             && atomic_compare_exchange_weak_explicit(&p->seq, &seq, seq + 1,
+                                                      memory_order_acquire,
+                                                      memory_order_relaxed) )
+            break;
+        sched_yield();
+    }
+    atomic_thread_fence(memory_order_release);
+
+    memcpy(p->digits, digits, sizeof(p->digits));
+    memcpy(p->title, title, sizeof(p->title));
+    p->frames++;
+
+    atomic_store_explicit(&p->seq, seq + 2, memory_order_release);
+    atomic_fetch_add_explicit(&shared->generation, 1, memory_order_release);
+}
+
+int main(int argc, char *argv[])
+{
+    struct ledshm       *shared;
+    struct ledshm_panel *p;
+    struct sigaction     action;
+    unsigned char        digits[8];
+    char                 title[81];
+    char                 line[256];
+    char                *text = "";
+    uint32_t             owner = 0;
+    int                  number = 0;
+    int                  letter, fd;
+
+    while ( ( letter = getopt(argc, argv, "p:t:")) != -1 ) {
+        switch (letter) {
+            case 'p':  number = atoi(optarg);  break;
+            case 't':  text = optarg;          break;
+            default:
+                fprintf(stderr, "Usage: %s [-p panel] [-t title] name\n",
+                        argv[0]);
+                exit(1);
+        }
+    }
+    if ( optind != argc - 1 ) {
+        fprintf(stderr, "Usage: %s [-p panel] [-t title] name\n", argv[0]);
+        exit(1);
+    }
+
+    fd = shm_open(argv[optind], O_RDWR, 0);
+    if ( fd == -1 ) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fd, 0);
+    if ( shared == MAP_FAILED ) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    close(fd);
+
+    if ( shared->magic != LEDSHM_MAGIC ) {
+        fprintf(stderr, "%s is not a clock's frame buffer\n", argv[optind]);
+        exit(1);
+    }
+    if ( number < 0 || number >= shared->npanels ) {
+        fprintf(stderr, "%s has no panel %d\n", argv[optind], number);
+        exit(1);
+    }
+    p = &shared->panel[number];
+
+    if ( ! atomic_compare_exchange_strong(&p->owner, &owner, getpid()) ) {
+        fprintf(stderr, "Panel %d is already drawn by process %u\n",
+                number, owner);
+        exit(1);
+    }
+
+    // an interrupted read ends the loop, so the panel goes back
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = interrupt;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGHUP, &action, NULL);
+
+    frame_title(title, text);
+    while ( ! interrupted && fgets(line, sizeof(line), stdin) != NULL ) {
+        encode_line(line, digits);
+        write_panel(shared, p, digits, title);
+    }
+
+    atomic_store_explicit(&p->owner, 0, memory_order_release);
+    return 0;
+}
@@ -7,93 +7,157 @@
 
 #include "clock.h"
 
+#include <sys/timerfd.h>
+#include <stdint.h>
+#include <errno.h>
+
 
 /* MODEL */
 
-/* The offset and timezone are properly part of the model, so they
- * go in this module, with getters and setters.
+/* The offset and time zone are kept for each clock face, with the
+ * face's other settings, in its clockcore (see clockcore.c).  The
+ * ones from the command line are in the controller.
  */
 
-int offset = 0;
-
-int get_offset()
-{
-    return offset;
-}
+/* How long before each second the timer should go off, so the frame
+ * is drawn by the time the second starts.  Kept in nanoseconds.
+ */
+long tick_lead = 0;
 
-void set_offset(int new_offset)
+void set_tick_lead(int msec)
 {
-    offset = new_offset;
+    if ( msec < 0 || msec > 999 ) {
+        fprintf(stderr, "lead time must be 0 to 999 milliseconds\n");
+        exit(1);
+    }
+    tick_lead = msec * 1000000L;
 }
 
 
-// If you do timezone stuff, it goes in here too.
-// Probably want names like "set_tokyotime()" and
-// "set_rowantime()" or something like that.
-// See "paristime.c" in /opt/kilroy/labtech/ZoneChange
-// to see how this is done.
+/* How often the timer ticks, in nanoseconds: once a second normally,
+ * up to 100 times a second for showing hundredths.
+ */
+long tick_period = 1000000000L;
 
+void set_tick_rate(int per_second)
+{
+    if ( per_second < 1 || per_second > 100 ) {
+        fprintf(stderr, "tick rate must be 1 to 100 a second\n");
+        exit(1);
+    }
+    tick_period = 1000000000L / per_second;
+}
 
 
 /* This function is called when the timer ticks.
- * Then it calls the newtime() function in the controller.
+ * Then it calls the newtime() function in the controller, with the
+ * actual time (no offset) the clock was read at.
  *
  * Note we ignore the argument!
- * sigaction() arranges to pass us the signal that caused the function
- * to be called, so you can use one signal handler for multiple signals.
- * But we only catch one signal, so no need to worry about it.
+ * It used to be the signal number when this was a SIGALRM handler;
+ * now it runs from the event loop in normal context.
  */
 void tick(int sig)
 {
+    struct timespec right_now;
     time_t       now;
-    struct tm   *dateinfo;  // localtime() returns a pointer, so it
-                            // allocates space.  We just need a pointer.
+    int          hundredths;
+
+    /* read the clock once; if the timer fires early to leave room
+     * for drawing, show the tick it's early for
+     */
+    read_clock(&right_now);
+    right_now.tv_nsec += tick_lead;
+    now = right_now.tv_sec + right_now.tv_nsec / 1000000000;
+    hundredths = (right_now.tv_nsec % 1000000000) / 10000000;
+
+    /* tell controller there's new time data, and when it was read;
+     * it turns that into local time for each clock face
+     */
+    new_time(now, hundredths);
+}
+
+
+/* Arm the timer for the next whole tick of wall-clock time (the next
+ * second, normally), less the lead, and every tick after that.  The
+ * deadlines are absolute, so the display changes when the real second
+ * does (not a second after we happened to start) and scheduling delays
+ * don't pile up.
+ *
+ * TFD_TIMER_CANCEL_ON_SET makes the timer report ECANCELED if somebody
+ * sets the clock, so we can line up with the new seconds.
+ */
+static void arm_timer(int fd)
+{
+    struct itimerspec deadline;
+    struct timespec   now;
+    long              next;   // nanoseconds after now.tv_sec
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    // the next tick whose deadline (tick_lead before it) is still ahead
+    next = (now.tv_nsec + tick_lead) / tick_period * tick_period
+           + tick_period - tick_lead;
+
+    deadline.it_value.tv_sec = now.tv_sec + next / 1000000000;
+    deadline.it_value.tv_nsec = next % 1000000000;
+    deadline.it_interval.tv_sec = tick_period / 1000000000;
+    deadline.it_interval.tv_nsec = tick_period % 1000000000;
+
+    if ( timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+                         &deadline, NULL) == -1 ) {
+        perror("Could not start timer");
+        exit(1);
+    }
+}
+
 
-    /* get current time into "struct tm" object */
-    (void) time(&now);
-    now += offset;
-    dateinfo = localtime( &now );
+/* The event loop calls this when the timer descriptor is readable.
+ * Reading it says how many intervals went by; if we fell behind we
+ * only draw the latest time, since that's the one anybody can see.
+ * The frame itself comes from the frame scheduler, which calls tick().
+ */
+static void timer_ready(int fd)
+{
+    uint64_t expirations;
 
-    /* tell controller there's new time data */
-    new_time(dateinfo);
+    if ( read(fd, &expirations, sizeof(expirations)) != sizeof(expirations) ) {
+        if ( errno != ECANCELED )
+            return;
+        arm_timer(fd);  // the clock was set; line up with it again
+        expirations = 1;
+    }
+
+    stats_ticks(expirations);
+    request_frame(FRAME_TIMER);
 }
 
 
-/* Set up an interval timer for our clock.
+/* Set up a timer for our clock.
  * This is the model; it's what actually measures real time passing.
- * When the interval is over, this calls tick(), which puts the
+ * When each second starts, this calls tick(), which puts the
  * information into a structure and then passes that back to the
  * controller.
+ *
+ * The timer is a timerfd(2), so it shows up in the event loop as a
+ * descriptor to read instead of interrupting whatever we're doing.
  */
 void start_timer()
 {
-    struct itimerval interval; // interval object
-    struct sigaction new_action, old_action;  // signal actions
-
-    // The manual page signal.h(0P) has a list of all signals.
-
-    // blank out the signal mask
-    sigemptyset( &new_action.sa_mask );
-    // clear flags (our application is pretty simple)
-    new_action.sa_flags = 0;
-    // set tick() as the signal handler when we get the timer signal.
-    new_action.sa_handler = tick;
- 
-    /* sigaction takes a pointer as an argument, so you have to
-     * allocate space.  The declaration of new_action() up above
-     * has no star - that's the actual object, not just a pointer.
-     */
-    if ( sigaction(SIGALRM, &new_action, &old_action) == -1 ) {
-        perror("Could not set new handler for SIGALRM");
+    int timer_fd;
+
+    if ( tick_lead >= tick_period ) {
+        fprintf(stderr, "lead time must be less than the time between ticks\n");
+        exit(1);
+    }
+
+    timer_fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if ( timer_fd == -1 ) {
+        perror("Could not create timer");
         exit(1);
     }
 
-    // set interval to 1.000 seconds.
-    interval.it_value.tv_sec = 1;
-    interval.it_value.tv_usec = 0;
-    interval.it_interval = interval.it_value;
+    arm_timer(timer_fd);
 
-    // use the interval object to set a timer for the real time clock
-    // NOTE: takes a pointer, so no * in our declaration of 'interval'
-    setitimer(ITIMER_REAL, &interval, NULL);
+    add_event_source(timer_fd, timer_ready);
 }
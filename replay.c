@@ -0,0 +1,254 @@
+/* replay.c -- recording a session, and playing it back
+ *
+ * "clock -R file" writes down every tick, every key and every frame
+ * each face showed, with the wall and monotonic clocks as they were.
+ * "clock -P file", given the same flags otherwise, plays the ticks and
+ * keys back through new_time() and process_key(), with the clocks
+ * reading the recorded times, as fast as it can.  Every frame is
+ * checked against the recorded one, so a change that makes the clock
+ * show something different (say, the date or test mode ending a
+ * second late) is caught, and the time it takes is a benchmark of a
+ * real session.  Replays use the null LED backend unless
+ * CLOCKLEDBACKEND says otherwise; text faces still print, so send
+ * them to /dev/null.
+ *
+ * Alarms are read against the real clock, so leave -A out of both.
+ *
+ * The file is a header and then fixed-size records, in the machine's
+ * own byte order; it's meant to be played back where it was made.
+ */
+
+#include "clock.h"
+
+#include <stdint.h>
+
+#define RECORD_MAGIC "CLK2"
+
+struct header {
+    char     magic[4];
+    uint32_t nfaces;
+    int64_t  wall;        // when the session started, in seconds
+    int64_t  mono;        // and on the monotonic clock, in ns
+};
+
+struct record {
+    unsigned char  kind;       // 'T'ick, 'K'ey or 'F'rame
+    unsigned char  face;       // there are at most MAX_FACES
+    unsigned short data;       // hundredths, keybits or view properties
+    int64_t        wall;       // the wall clock, in seconds
+    int64_t        mono;       // the monotonic clock, in ns
+    unsigned char  digits[8];  // a frame's LEDs, as in LED-layout.txt
+};
+
+static FILE *recording = NULL;
+static FILE *playing = NULL;
+static char *play_name;
+
+void record_to(char *file)
+{
+    if ( ( recording = fopen(file, "w") ) == NULL ) {
+        perror(file);
+        exit(1);
+    }
+    setvbuf(recording, NULL, _IOFBF, 1 << 16);
+}
+
+void replay_from(char *file)
+{
+    if ( ( playing = fopen(file, "r") ) == NULL ) {
+        perror(file);
+        exit(1);
+    }
+    play_name = file;
+    setenv("CLOCKLEDBACKEND", "null", 0);
+}
+
+static void write_record(int kind, int face, int data, time_t wall,
+                         long long mono, digit *digits)
+{
+    struct record r;
+
+    memset(&r, 0, sizeof(r));
+    r.kind = kind;
+    r.face = face;
+    r.data = data;
+    r.wall = wall;
+    r.mono = mono;
+    if ( digits )
+        memcpy(r.digits, digits, sizeof(r.digits));
+
+    if ( fwrite(&r, sizeof(r), 1, recording) != 1 ) {
+        perror("Could not record");
+        exit(1);
+    }
+}
+
+void record_tick(time_t now, int hundredths, long long mono)
+{
+    if ( recording )
+        write_record('T', 0, hundredths, now, mono, NULL);
+}
+
+void record_key(int face, keybits key, time_t now, long long mono)
+{
+    if ( recording )
+        write_record('K', face, key, now, mono, NULL);
+}
+
+// after a frame has gone out, what face "face" showed in it
+void record_frame(int face, int view_props, digit *digits)
+{
+    struct timespec now;
+
+    if ( ! recording )
+        return;
+    read_clock(&now);
+    write_record('F', face, view_props, now.tv_sec, read_monotonic(), digits);
+}
+
+
+/* PLAYBACK: the clocks read whatever the record being played says */
+
+static struct timespec replay_now;
+static long long       replay_mono;
+
+static void replay_clock(struct timespec *now)
+{
+    *now = replay_now;
+}
+
+static long long replay_monotonic(void)
+{
+    return replay_mono;
+}
+
+/* Called once the faces are set up, before anything reads the time.
+ * Writes the header, or reads it and starts the clocks where the
+ * recording started.
+ */
+void record_start(void)
+{
+    struct header   h;
+    struct timespec now;
+    int             nfaces = 0;
+
+    while ( face_number(nfaces) )
+        nfaces++;
+
+    if ( recording ) {
+        read_clock(&now);
+        memcpy(h.magic, RECORD_MAGIC, sizeof(h.magic));
+        h.nfaces = nfaces;
+        h.wall = now.tv_sec;
+        h.mono = read_monotonic();
+        if ( fwrite(&h, sizeof(h), 1, recording) != 1 ) {
+            perror("Could not record");
+            exit(1);
+        }
+    }
+
+    if ( playing ) {
+        if ( fread(&h, sizeof(h), 1, playing) != 1
+             || memcmp(h.magic, RECORD_MAGIC, sizeof(h.magic)) != 0 ) {
+            end_display();
+            fprintf(stderr, "%s is not a clock recording\n", play_name);
+            exit(1);
+        }
+        if ( h.nfaces != nfaces ) {
+            end_display();
+            fprintf(stderr, "%s was recorded with %u faces, not %d; "
+                            "use the same flags\n", play_name, h.nfaces, nfaces);
+            exit(1);
+        }
+        replay_now.tv_sec = h.wall;
+        replay_now.tv_nsec = 0;
+        replay_mono = h.mono;
+        set_clock_source(replay_clock);
+        set_monotonic_source(replay_monotonic);
+    }
+}
+
+// 1 if the face shows what the record says it did
+static int same_frame(struct record *r)
+{
+    struct face *f = face_number(r->face);
+
+    if ( f == NULL || get_view_properties_r(f->core) != r->data )
+        return 0;
+    if ( ! ( get_view_properties_r(f->core) & LED_MODE ) )
+        return 1;
+    select_face(f);
+    return memcmp(get_display_location(), r->digits, sizeof(r->digits)) == 0;
+}
+
+static void report_frame(struct record *r, unsigned long n)
+{
+    struct face *f = face_number(r->face);
+    digit       *got;
+    int          i;
+
+    fprintf(stderr, "frame %lu, face %d at %lld: wanted %02x", n, r->face,
+            (long long) replay_now.tv_sec, r->data);
+    for (i = 0; i < 8; i++)
+        fprintf(stderr, " %02x", r->digits[i]);
+    if ( f == NULL ) {
+        fprintf(stderr, ", but there is no such face\n");
+        return;
+    }
+    select_face(f);
+    fprintf(stderr, ", got %02x", get_view_properties());
+    got = ( get_view_properties() & LED_MODE ) ? get_display_location() : NULL;
+    for (i = 0; i < 8; i++)
+        fprintf(stderr, " %02x", got ? got[i] : 0);
+    fprintf(stderr, "\n");
+}
+
+/* Play the whole file back, say how it went, and stop the clock:
+ * with status 1 if any frame came out different.
+ */
+void replay(void)
+{
+    struct record r;
+    unsigned long ticks = 0, keys = 0, frames = 0, wrong = 0;
+    long long     started, took;
+
+    if ( ! playing )
+        return;
+
+    started = monotonic_ns();
+    while ( fread(&r, sizeof(r), 1, playing) == 1 ) {
+        switch ( r.kind ) {
+            case 'T':
+                replay_now.tv_sec = r.wall;
+                replay_now.tv_nsec = r.data * 10000000L;
+                replay_mono = r.mono;
+                new_time(r.wall, r.data);
+                ticks++;
+                break;
+            case 'K':
+                // the recording ends at a quit
+                if ( is_quit_key(r.data) || face_number(r.face) == NULL )
+                    goto done;
+                replay_now.tv_sec = r.wall;
+                replay_mono = r.mono;
+                select_face(face_number(r.face));
+                process_key(r.data);
+                keys++;
+                break;
+            case 'F':
+                if ( ! same_frame(&r) && wrong++ < 10 )
+                    report_frame(&r, frames);
+                frames++;
+                break;
+        }
+    }
+done:
+    took = monotonic_ns() - started;
+
+    end_display();
+    fprintf(stderr, "%lu ticks, %lu keys, %lu frames in %.3f ms "
+                    "(%.0f ticks/s); %lu frames different\n",
+            ticks, keys, frames, took / 1e6,
+            took ? ticks * 1e9 / took : 0.0, wrong);
+    exit(wrong ? 1 : 0);
+}
@@ -0,0 +1,166 @@
+/* stats.c -- counters for the clock's hot path
+ *
+ * Always on, so they have to be cheap: each event is a couple of
+ * additions and maybe a monotonic clock read (which goes through the
+ * vDSO).  Times go into power-of-two histograms so we can report
+ * rough percentiles without keeping every sample.
+ *
+ * The numbers can be shown in the title bar (the "Stats" key) and
+ * written to a file every STATS_PERIOD seconds.
+ */
+
+#include "clock.h"
+
+#define STATS_BUCKETS 20     // bucket i counts times under 2^i usec
+#define STATS_PERIOD  10     // seconds between stats file updates
+
+struct histogram {
+    unsigned long count;
+    unsigned long bucket[STATS_BUCKETS];
+};
+
+static unsigned long    ticks;         // timer ticks delivered
+static unsigned long    ticks_missed;  // intervals folded into a later tick
+static struct histogram frame_times;   // how long display() took
+static struct histogram key_times;     // get_key() until its frame is drawn
+static unsigned long    keys_dropped;  // keys that came with the queue full
+
+static char  *stats_file = NULL;
+static time_t next_write = 0;
+
+long long monotonic_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void record(struct histogram *h, long long ns)
+{
+    unsigned long usec = ns > 0 ? ns / 1000 : 0;
+    int           i = 0;
+
+    if ( usec > 0 )
+        i = 64 - __builtin_clzl(usec);    // bits needed to hold usec
+    if ( i >= STATS_BUCKETS )
+        i = STATS_BUCKETS - 1;
+
+    h->bucket[i]++;
+    h->count++;
+}
+
+// upper bound, in usec, of the bucket holding the p-th percentile
+static unsigned long percentile(struct histogram *h, int p)
+{
+    unsigned long want, seen = 0;
+    int           i;
+
+    if ( h->count == 0 )
+        return 0;
+
+    want = (h->count * p + 99) / 100;
+    for (i = 0; i < STATS_BUCKETS; i++) {
+        seen += h->bucket[i];
+        if ( seen >= want )
+            break;
+    }
+    return 1UL << (i < STATS_BUCKETS ? i : STATS_BUCKETS - 1);
+}
+
+void stats_ticks(unsigned long long expirations)
+{
+    ticks++;
+    if ( expirations > 1 )
+        ticks_missed += expirations - 1;
+}
+
+void stats_frame(long long ns)
+{
+    record(&frame_times, ns);
+}
+
+void stats_key(long long ns)
+{
+    record(&key_times, ns);
+}
+
+void stats_key_dropped(void)
+{
+    keys_dropped++;
+}
+
+/* One line for the title bar, framed with dashes like the usual title.
+ * "out" is what the display has sent to the terminals, as the driver
+ * counts it; curses does its own writing, so it's left out then.
+ */
+char *stats_title(void)
+{
+    static char title[81];
+    char        text[256];   // frame_title() cuts it to fit
+    char        out[24];
+    long long   bytes = display_bytes();
+
+    out[0] = '\0';
+    if ( bytes >= 0 )
+        snprintf(out, sizeof(out), "  out %lldk", bytes / 1024);
+
+    snprintf(text, sizeof(text),
+             " ticks %lu missed %lu  frame p50 %luus p99 %luus"
+             "  keys %lu p99 %luus lost %lu%s ",
+             ticks, ticks_missed,
+             percentile(&frame_times, 50), percentile(&frame_times, 99),
+             key_times.count, percentile(&key_times, 99), keys_dropped,
+             out);
+
+    frame_title(title, text);
+    return title;
+}
+
+static void write_histogram(FILE *out, char *name, struct histogram *h)
+{
+    int i;
+
+    fprintf(out, "%s_count %lu\n", name, h->count);
+    fprintf(out, "%s_p50_us %lu\n", name, percentile(h, 50));
+    fprintf(out, "%s_p99_us %lu\n", name, percentile(h, 99));
+    fprintf(out, "%s_hist_us", name);
+    for (i = 0; i < STATS_BUCKETS; i++)
+        fprintf(out, " %lu:%lu", 1UL << i, h->bucket[i]);
+    fprintf(out, "\n");
+}
+
+void set_stats_file(char *path)
+{
+    stats_file = path;
+}
+
+/* Called every tick.  Every STATS_PERIOD seconds, write the numbers to
+ * a temporary file and rename it over the stats file, so readers never
+ * see half of one.
+ */
+void stats_update(time_t now)
+{
+    char  tmpname[4096];
+    FILE *out;
+
+    if ( stats_file == NULL || now < next_write )
+        return;
+    next_write = now + STATS_PERIOD;
+
+    snprintf(tmpname, sizeof(tmpname), "%s.tmp", stats_file);
+    if ( ( out = fopen(tmpname, "w") ) == NULL )
+        return;
+
+    fprintf(out, "time %ld\n", (long) now);
+    fprintf(out, "ticks %lu\n", ticks);
+    fprintf(out, "ticks_missed %lu\n", ticks_missed);
+    write_histogram(out, "frame", &frame_times);
+    write_histogram(out, "key", &key_times);
+    fprintf(out, "keys_dropped %lu\n", keys_dropped);
+    if ( display_bytes() >= 0 )
+        fprintf(out, "bytes_out %lld\n", display_bytes());
+
+    if ( fclose(out) == 0 )
+        rename(tmpname, stats_file);
+}
@@ -0,0 +1,183 @@
+/* stopwatch.c -- stopwatch, countdown and interval timers
+ *
+ * These are part of the model, like the time of day, but they measure
+ * time on CLOCK_MONOTONIC, so setting the wall clock (or an NTP step)
+ * doesn't make a running timer jump.  Everything is in nanoseconds;
+ * "now" is always a monotonic_ns() reading from the caller, so all the
+ * faces drawn in one frame agree.
+ *
+ * A countdown can be a length ("90", "5:00", "1:30:00") or a time of
+ * day to count down to ("noon" or "midnight"), which is worked out
+ * from the wall clock when the countdown starts.
+ */
+
+#include "clock.h"
+
+#define SECOND 1000000000LL
+
+// what new clock faces start with; see set_countdown() and set_interval()
+static struct timer default_timer = { .kind = TIMER_OFF, .target = -1 };
+
+/* "90", "5:00" or "1:30:00" into nanoseconds; -1 if it's none of those */
+static long long parse_length(char *s)
+{
+    long long secs = 0;
+    long      part;
+    char     *end;
+    int       parts = 0;
+
+    do {
+        if ( parts++ == 3 || ! isdigit((unsigned char) *s) )
+            return -1;
+        part = strtol(s, &end, 10);
+        secs = secs * 60 + part;
+        s = end;
+    } while ( *s++ == ':' );
+
+    return ( *end == '\0' && secs > 0 ) ? secs * SECOND : -1;
+}
+
+void set_countdown(char *what)
+{
+    if ( strcmp(what, "midnight") == 0 ) {
+        default_timer.target = 0;
+    } else if ( strcmp(what, "noon") == 0 ) {
+        default_timer.target = 12 * 3600;
+    } else if ( ( default_timer.countdown = parse_length(what) ) == -1 ) {
+        fprintf(stderr, "countdown must be noon, midnight, or [[h:]m:]s\n");
+        exit(1);
+    }
+    default_timer.kind = TIMER_COUNTDOWN;
+}
+
+void set_interval(char *what)
+{
+    if ( ( default_timer.interval = parse_length(what) ) == -1 ) {
+        fprintf(stderr, "interval must be [[h:]m:]s\n");
+        exit(1);
+    }
+    default_timer.kind = TIMER_INTERVAL;
+}
+
+struct timer get_timer()
+{
+    return default_timer;
+}
+
+
+// time the timer has run, counting any time before it was last stopped
+static long long elapsed(struct timer *t, long long now)
+{
+    return t->elapsed + ( t->running ? now - t->started : 0 );
+}
+
+/* Start (or carry on) timing.  "wall" is the local time now, which a
+ * countdown to noon or midnight needs to know how long it is.
+ */
+void timer_start(struct timer *t, long long now, struct tm *wall)
+{
+    long since_midnight, left;
+
+    if ( t->running || t->kind == TIMER_OFF )
+        return;
+
+    // a fresh countdown: fix its length now
+    if ( t->kind == TIMER_COUNTDOWN && t->elapsed == 0 ) {
+        t->length = t->countdown;
+        if ( t->target >= 0 ) {
+            since_midnight = wall->tm_hour * 3600 + wall->tm_min * 60
+                             + wall->tm_sec;
+            left = t->target - since_midnight;
+            if ( left <= 0 )
+                left += 24 * 3600;
+            t->length = left * SECOND;
+        }
+    }
+    if ( t->kind == TIMER_COUNTDOWN && t->elapsed >= t->length )
+        return;   // already run out; reset it first
+
+    t->started = now;
+    t->running = 1;
+}
+
+void timer_stop(struct timer *t, long long now)
+{
+    if ( ! t->running )
+        return;
+    t->elapsed = elapsed(t, now);
+    t->running = 0;
+}
+
+void timer_reset(struct timer *t)
+{
+    t->running = 0;
+    t->elapsed = 0;
+    t->length = 0;
+    t->lap_at = 0;
+    t->laps = 0;
+}
+
+/* Mark a lap; returns the lap's own time (since the last lap). */
+long long timer_lap(struct timer *t, long long now)
+{
+    long long at = elapsed(t, now);
+    long long split = at - t->lap_at;
+
+    t->lap_at = at;
+    t->laps++;
+    return split;
+}
+
+/* Switch to the next kind of timer, skipping countdowns and intervals
+ * that haven't been given a length, and back round to the time of day.
+ */
+void timer_next_kind(struct timer *t)
+{
+    do {
+        t->kind = (t->kind + 1) % TIMER_KINDS;
+    } while ( ( t->kind == TIMER_COUNTDOWN
+                && t->countdown <= 0 && t->target < 0 )
+              || ( t->kind == TIMER_INTERVAL && t->interval <= 0 ) );
+    timer_reset(t);
+}
+
+/* What the timer shows at "now", in nanoseconds: time run so far for
+ * a stopwatch, time left for a countdown, and time left in this round
+ * for an interval timer.  A countdown that gets to zero stops there.
+ */
+long long timer_reading(struct timer *t, long long now)
+{
+    long long ran = elapsed(t, now);
+
+    switch ( t->kind ) {
+        case TIMER_COUNTDOWN:
+            if ( t->running && ran >= t->length ) {
+                t->running = 0;
+                t->elapsed = ran = t->length;
+            }
+            return t->length - ran;
+        case TIMER_INTERVAL:
+            return t->interval - ran % t->interval;
+    }
+    return ran;
+}
+
+/* When the reading next moves to another whole "unit" (a second, say),
+ * so the frame can be drawn right then; 0 if it isn't running.
+ */
+long long timer_next_change(struct timer *t, long long now, long long unit)
+{
+    long long ran, left;
+
+    if ( ! t->running )
+        return 0;
+
+    ran = elapsed(t, now);
+    if ( t->kind == TIMER_STOPWATCH )
+        left = unit - ran % unit;
+    else
+        left = timer_reading(t, now) % unit;   // counting down
+    if ( left == 0 )
+        left = unit;
+    return now + left;
+}
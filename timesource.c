@@ -0,0 +1,41 @@
+/* timesource.c -- where the clock gets the time from
+ *
+ * The clock is read once per tick with clock_gettime(), which goes
+ * through the vDSO and doesn't make a system call.  Each face turns
+ * that into a "struct tm" itself, with time_in_zone_r() in
+ * clockcore.c, which only has to look it up once a minute.
+ */
+
+#include "clock.h"
+
+static void real_clock(struct timespec *now)
+{
+    clock_gettime(CLOCK_REALTIME, now);
+}
+
+// where the time comes from; tests and benchmarks can swap this out
+static void (*clock_source)(struct timespec *) = real_clock;
+
+void set_clock_source(void (*source)(struct timespec *))
+{
+    clock_source = source ? source : real_clock;
+}
+
+// read the wall clock once; everything else in a tick uses this
+void read_clock(struct timespec *now)
+{
+    clock_source(now);
+}
+
+// the monotonic clock the timers run on; a replay swaps this out too
+static long long (*monotonic_source)(void) = monotonic_ns;
+
+void set_monotonic_source(long long (*source)(void))
+{
+    monotonic_source = source ? source : monotonic_ns;
+}
+
+long long read_monotonic(void)
+{
+    return monotonic_source();
+}
@@ -8,19 +8,61 @@
 #include "clock.h"
 #include "view.h"
 
-/* see "view.h" for list of bits that set properties */
+/* see "clockcore.h" for list of bits that set properties */
 
-int view_props = 0x00; // default is 24-hour mode, plain text
+/* The view properties and hundredths of whichever face is being
+ * drawn, and the formatting, are kept by the clock core library (see
+ * clockcore.c), in that face's clockcore; the controller picks the
+ * face with set_view_core().  Until it does, the view has one of its
+ * own: 24-hour mode, plain text.
+ */
+static clockcore *view = NULL;
+
+void set_view_core(clockcore *c)
+{
+    view = c;
+}
+
+static clockcore *core(void)
+{
+    if ( view == NULL && ( view = clockcore_new() ) == NULL ) {
+        perror("Could not start the view");
+        exit(1);
+    }
+    return view;
+}
 
 // returns old properties so you can save them if needed
 void set_view_properties(int viewbits)
 {
-    view_props = viewbits;
+    set_view_properties_r(core(), viewbits);
 }
 
 int get_view_properties()
 {
-    return view_props;
+    return get_view_properties_r(core());
+}
+
+void set_hundredths(int h)
+{
+    set_hundredths_r(core(), h);
+}
+
+/* send the LED buffer to the screen, and keep track of how long it took;
+ * a frame that looks just like the last one isn't sent at all
+ */
+static void draw(void)
+{
+    long long start;
+
+    if ( ! display_changed() )
+        return;
+
+    start = monotonic_ns();
+
+    display();
+    fflush(stdout);
+    stats_frame(monotonic_ns() - start);
 }
 
 //this is where you turn all the bits on and then off for testing purposes
@@ -30,65 +72,26 @@ void do_test(struct tm *dateinfo){
     for(int i = 0; i < 6; i++){
         where[i] = 0xff;
     }
-    display();
-    fflush(stdout);
+    draw();
 }
 
-#define MAX_TIMESTR 40 // big enough for any valid data
+#define MAX_TIMESTR CLOCKCORE_TIMESTR // big enough for any valid data
+
 // make_timestring
-// returns a string formatted from the "dateinfo" object.
+// returns a string formatted from the "dateinfo" object; see
+// make_timestring_r() in clockcore.c for what it looks like
 char * make_timestring (struct tm *dateinfo, int dividers)
 {
-    char *timeformat; // see strftime(3)
-
-    if ( view_props & DATE_MODE ) {
-        // if dividers is true:
-        //   make a string such as "10/31/12 dt" or " 3/17/12 dt"
-        //   (note: no leading zero on month!)
-        // if dividers is false:
-        //   make a string such as "103112d" or " 31712d"
-        //   (note: no leading zero on month!)
-        // 
-	    if(dividers){
-            timeformat = "%-m/%d/%Y dt";
-	    }
-	    else{
-	        timeformat = "%-m%d%Yd";    
-	    }
-    } else {
-        // if dividers is true:
-        //   am/pm: make a string such as "11:13:52 am" or " 4:21:35 pm"
-        //          (note: no leading zero on hour!)
-        //   24 hr: make a string such as "14:31:25 24"
-        //          (include leading zero on hour)
-        // if dividers is false:
-        //   am/pm: make a string such as "111352a" or " 42135p"
-        //          (note: no leading zero on hour!)
-        //   24 hr: make a string such as "1431252"
-        //          (include leading zero on hour)
-        // see strftime(3) for details
-        if ( dividers ) {
-            if ( view_props & AMPM_MODE ) {
-		        timeformat = "%l:%M:%S %p";
-            } 
-	        else {
-                timeformat = "%H:%M:%S 24";
-            }
-        } 
-	    else {
-            if(view_props & AMPM_MODE){
-		        timeformat = "%l%M%S";
-	        }
-	        else {
-		        timeformat = "%H%M%S";
-	        }
-	    }
-    }
-
-    // make the timestring and return it
     static char timestring[MAX_TIMESTR];
-    strftime(timestring, MAX_TIMESTR, timeformat, dateinfo);
-    return timestring;
+
+    return make_timestring_r(core(), dateinfo, dividers, timestring);
+}
+
+// encode_led
+// turns the whole frame for "dateinfo" into LED bits
+void encode_led(struct tm *dateinfo, digit *where)
+{
+    encode_led_r(core(), dateinfo, where);
 }
 
 /* We get a pointer to a "struct tm" object, put it in a string, and
@@ -96,75 +99,43 @@ char * make_timestring (struct tm *dateinfo, int dividers)
  */
 void show_led(struct tm *dateinfo)
 {
-
-    digit *where = get_display_location();
-    int i;
-    digit bitvalues = 0;
-    int hour = dateinfo->tm_hour;
-    int indicator;
-
-    if ( view_props & TEST_MODE ) {
+    if ( get_view_properties() & TEST_MODE ) {
         do_test(dateinfo);
         return;
     }
-    
-    for (i = 0; i < 6; i++) {
-        switch ( make_timestring(dateinfo, 0)[i] ) {
-            case ' ': bitvalues = 0x00; break;
-	        case '1': bitvalues = 0x24; break; //0010 0100
-            case '2': bitvalues = 0x5d; break; //0101 1101
-            case '3': bitvalues = 0x6d; break; //0110 1101
-            case '4': bitvalues = 0x2e; break; //0010 1110
-            case '5': bitvalues = 0x6b; break; //0110 1011 
-            case '6': bitvalues = 0x7b; break; //0111 1011
-            case '7': bitvalues = 0x25; break; //
-            case '8': bitvalues = 0x7f; break; //
-            case '9': bitvalues = 0x6f; break; //
-            case '0': bitvalues = 0x77; break; //0111 0111
-        }
-        where[i] = bitvalues;
-        where[7] |= 0xf0; //switch on colon dots
-    }  
-
-    if(view_props & AMPM_MODE){
-    	where[7] &= ~0x04;
-        if(hour >= 12){
-            where[7] |= 0x02;
-        }
-        else{
-            where[7] |= 0x01;
-        }
-    }
-    else{
-        where[7] = 0x04;
-    }
 
-    if(dateinfo->tm_sec % 2 == 0){
-    	where[7] |= 0xf0; //switch on colon dots
-    }
-   
-    if(view_props & DATE_MODE) {
-        where[7] = 0x08;
-    }
-   // else {
-   //     where[7] &= 0x04;
-   // }
+    encode_led(dateinfo, get_display_location());
 
-    display();
-    fflush(stdout);
+    draw();
 }
 
 void show_text(struct tm *dateinfo)
 {
+    static char shown[MAX_TIMESTR];
+    static int  rung = -1;    // the second the bell last rang in
+    char       *timestring = make_timestring(dateinfo, 1);
 
-    printf("\r%s ", make_timestring(dateinfo, 1));
+    // nothing new to say (a timer can draw between the clock's ticks)
+    if ( strcmp(timestring, shown) == 0 )
+        return;
+    strcpy(shown, timestring);
+
+    printf("\r%s ", timestring);
+    // no indicators to flash, so ring the bell, once in each even
+    // second however often we draw
+    if ( ! ( get_view_properties() & ALARM_MODE ) )
+        rung = -1;
+    else if ( dateinfo->tm_sec % 2 == 0 && dateinfo->tm_sec != rung ) {
+        putchar('\a');
+        rung = dateinfo->tm_sec;
+    }
     fflush(stdout);
 }
 
 
 void show(struct tm *dateinfo)
 {
-    if ( view_props & LED_MODE )
+    if ( get_view_properties() & LED_MODE )
         show_led(dateinfo);
     else
         show_text(dateinfo);        
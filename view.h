@@ -5,27 +5,26 @@
  * Copyright (C) Darren Provine, 2009-2019, All Rights Reserved
  */
 
-/* VIEW OPTIONS
- *
- * AMPM (default is 24-hour) --+
- * unused -------------------+ |
- * date -------------------+ | |
- * LED mode--------------+ | | |
- *                       | | | |
- * test -----------+     | | | |
- *                 |     | | | |
- *                 |     | | | |
- *                 V     V V V V
- *           0 0 0 0     0 0 0 0
+/* The view option bits (AMPM_MODE and so on) are in clockcore.h,
+ * since programs using the clock core library need them too.
  */
-#define  AMPM_MODE  0x01
-#define  DATE_MODE  0x04
-#define  LED_MODE   0x08
-#define  TEST_MODE  0x10
+#include "clockcore.h"
+
+// the clock whose properties the rest of these use and set
+void set_view_core(clockcore *);
 
 // set packed bits for what you want
 void set_view_properties( int );
 int get_view_properties( void );
 
+// hundredths of a second past the time being shown, for HIRES_MODE
+void set_hundredths( int );
+
 void show(struct tm *);
+void show_led(struct tm *);
+void show_text(struct tm *);
+char *make_timestring(struct tm *, int);
+
+// fill in all eight LED slots for a time without drawing them
+void encode_led(struct tm *, digit *);
 
@@ -0,0 +1,487 @@
+/* zoneinfo.c -- named time zones without setenv("TZ") and tzset()
+ *
+ * Each zone's TZif file (see tzfile(5)) is read once into a table of
+ * transition times.  Finding the local time is then a binary search
+ * for the last transition before "t", and some arithmetic.  Times past
+ * the end of the table use the POSIX TZ rule in the file's footer.
+ *
+ * Loaded zones are kept for the life of the program and shared by
+ * every clock face that uses them.
+ */
+
+#include "clockcore.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+struct zonetype {
+    long  gmtoff;          // seconds east of UTC
+    int   isdst;
+    char *abbr;            // points into "abbrs"
+};
+
+/* A POSIX TZ rule, for example "EST5EDT,M3.2.0,M11.1.0".
+ * Each change is "J" (Julian day, no Feb 29), "D" (zero-based day of
+ * the year) or "M" (month.week.weekday), at "time" seconds local time.
+ */
+struct change {
+    char kind;
+    int  day, week, month;
+    long time;
+};
+
+struct rule {
+    struct zonetype std, dst;
+    int             has_dst;
+    struct change   start, end;
+    char            names[2][16];
+};
+
+struct zone {
+    char            *name;
+    int              ntrans;
+    int64_t         *trans;     // when each transition happens
+    unsigned char   *types_at;  // which type starts at each one
+    int              ntypes;
+    struct zonetype *types;
+    char            *abbrs;
+    int              has_rule;
+    struct rule      rule;      // for times after the last transition
+    zone            *next;
+};
+
+static zone *zones = NULL;      // everything loaded so far
+static pthread_mutex_t zones_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* CALENDAR ARITHMETIC
+ *
+ * Days since 1970-01-01 to and from a proleptic Gregorian date,
+ * after Howard Hinnant's "chrono-compatible low-level date algorithms".
+ */
+static long days_from_civil(long y, int m, int d)
+{
+    long era, yoe, doy, doe;
+
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static void civil_from_days(long z, long *y, int *m, int *d)
+{
+    long era, doe, yoe, doy, mp;
+
+    z += 719468;
+    era = (z >= 0 ? z : z - 146096) / 146097;
+    doe = z - era * 146097;
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = yoe + era * 400 + (*m <= 2);
+}
+
+static int is_leap(long y)
+{
+    return ( y % 4 == 0 && y % 100 != 0 ) || y % 400 == 0;
+}
+
+// floor division, since times before 1970 are negative
+static long floor_div(int64_t a, long b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/* Fill in "tm" for UTC time "t" shown at "type"'s offset. */
+static void fill_tm(int64_t t, struct zonetype *type, struct tm *tm)
+{
+    int64_t local = t + type->gmtoff;
+    long    days = floor_div(local, 86400);
+    long    secs = local - (int64_t) days * 86400;
+    long    year;
+    int     month, mday;
+
+    civil_from_days(days, &year, &month, &mday);
+
+    tm->tm_sec = secs % 60;
+    tm->tm_min = (secs / 60) % 60;
+    tm->tm_hour = secs / 3600;
+    tm->tm_mday = mday;
+    tm->tm_mon = month - 1;
+    tm->tm_year = year - 1900;
+    tm->tm_wday = (int) ((days % 7 + 11) % 7);  // 1970-01-01 was a Thursday
+    tm->tm_yday = days - days_from_civil(year, 1, 1);
+    tm->tm_isdst = type->isdst;
+    tm->tm_gmtoff = type->gmtoff;
+    tm->tm_zone = type->abbr;
+}
+
+
+/* POSIX TZ RULES */
+
+// a zone abbreviation: letters, or anything in <angle brackets>
+static char *parse_name(char *s, char *name)
+{
+    int n = 0;
+
+    if ( *s == '<' ) {
+        for (s++; *s && *s != '>'; s++)
+            if ( n < 15 ) name[n++] = *s;
+        if ( *s != '>' )
+            return NULL;
+        s++;
+    } else {
+        for ( ; isalpha((unsigned char) *s); s++)
+            if ( n < 15 ) name[n++] = *s;
+    }
+    name[n] = '\0';
+    return n >= 3 ? s : NULL;
+}
+
+// [+-]hh[:mm[:ss]], into seconds
+static char *parse_time(char *s, long *secs)
+{
+    int  sign = 1;
+    long h = 0, m = 0, sec = 0;
+
+    if ( *s == '+' || *s == '-' )
+        sign = ( *s++ == '-' ) ? -1 : 1;
+    if ( ! isdigit((unsigned char) *s) )
+        return NULL;
+    h = strtol(s, &s, 10);
+    if ( *s == ':' ) {
+        m = strtol(s + 1, &s, 10);
+        if ( *s == ':' )
+            sec = strtol(s + 1, &s, 10);
+    }
+    *secs = sign * (h * 3600 + m * 60 + sec);
+    return s;
+}
+
+static char *parse_change(char *s, struct change *c)
+{
+    if ( *s == 'M' ) {
+        c->kind = 'M';
+        c->month = strtol(s + 1, &s, 10);
+        if ( *s++ != '.' ) return NULL;
+        c->week = strtol(s, &s, 10);
+        if ( *s++ != '.' ) return NULL;
+        c->day = strtol(s, &s, 10);
+    } else if ( *s == 'J' ) {
+        c->kind = 'J';
+        c->day = strtol(s + 1, &s, 10);
+    } else if ( isdigit((unsigned char) *s) ) {
+        c->kind = 'D';
+        c->day = strtol(s, &s, 10);
+    } else {
+        return NULL;
+    }
+
+    c->time = 2 * 3600;  // default is 02:00:00 local time
+    if ( *s == '/' )
+        s = parse_time(s + 1, &c->time);
+    return s;
+}
+
+/* Parse a TZ rule like "CET-1CEST,M3.5.0,M10.5.0/3".  Note that the
+ * offsets in a rule are hours *west* of UTC.  Returns 0 if it can't.
+ */
+static int parse_rule(char *s, struct rule *r)
+{
+    long off;
+
+    memset(r, 0, sizeof(*r));
+
+    if ( ( s = parse_name(s, r->names[0]) ) == NULL )
+        return 0;
+    if ( ( s = parse_time(s, &off) ) == NULL )
+        return 0;
+    r->std.gmtoff = -off;
+    r->std.abbr = r->names[0];
+
+    if ( *s == '\0' )
+        return 1;
+
+    if ( ( s = parse_name(s, r->names[1]) ) == NULL )
+        return 0;
+    r->dst.gmtoff = r->std.gmtoff + 3600;
+    if ( *s != ',' && *s != '\0' ) {
+        if ( ( s = parse_time(s, &off) ) == NULL )
+            return 0;
+        r->dst.gmtoff = -off;
+    }
+    r->dst.isdst = 1;
+    r->dst.abbr = r->names[1];
+    r->has_dst = 1;
+
+    // no dates given: use the US rules, like glibc does
+    if ( *s == '\0' ) {
+        s = "M3.2.0,M11.1.0";
+    } else if ( *s++ != ',' ) {
+        return 0;
+    }
+    if ( ( s = parse_change(s, &r->start) ) == NULL || *s++ != ',' )
+        return 0;
+    if ( ( s = parse_change(s, &r->end) ) == NULL )
+        return 0;
+    return *s == '\0';
+}
+
+// days from 1970 to the day "c" happens in "year"
+static long change_day(struct change *c, long year)
+{
+    long first, day;
+    int  wday, mdays;
+    static int month_days[] = { 31,28,31,30,31,30,31,31,30,31,30,31 };
+
+    switch ( c->kind ) {
+        case 'J':  // 1..365, never counting Feb 29
+            day = c->day - 1;
+            if ( is_leap(year) && c->day >= 60 )
+                day++;
+            return days_from_civil(year, 1, 1) + day;
+        case 'D':  // 0..365
+            return days_from_civil(year, 1, 1) + c->day;
+    }
+
+    // 'M': weekday "day" of week "week" (5 means the last) of "month"
+    first = days_from_civil(year, c->month, 1);
+    wday = (int) ((first % 7 + 11) % 7);
+    day = first + (c->day - wday + 7) % 7 + (c->week - 1) * 7;
+    mdays = month_days[c->month - 1] + (c->month == 2 && is_leap(year));
+    while ( day >= first + mdays )
+        day -= 7;
+    return day;
+}
+
+static struct zonetype *rule_type(struct rule *r, int64_t t)
+{
+    long    year;
+    int     month, mday;
+    int64_t start, end;
+
+    if ( ! r->has_dst )
+        return &r->std;
+
+    civil_from_days(floor_div(t + r->std.gmtoff, 86400), &year, &month, &mday);
+
+    // both changes are given in the local time in force just before them
+    start = (int64_t) change_day(&r->start, year) * 86400
+            + r->start.time - r->std.gmtoff;
+    end = (int64_t) change_day(&r->end, year) * 86400
+          + r->end.time - r->dst.gmtoff;
+
+    if ( start < end )   // northern hemisphere
+        return ( t >= start && t < end ) ? &r->dst : &r->std;
+    else                 // southern: DST runs over new year
+        return ( t >= end && t < start ) ? &r->std : &r->dst;
+}
+
+
+/* READING TZif FILES */
+
+static int64_t get_be(unsigned char *p, int size)
+{
+    uint64_t v = 0;
+    int      i;
+
+    for (i = 0; i < size; i++)
+        v = (v << 8) | p[i];
+    if ( size == 4 )
+        return (int32_t) v;
+    return (int64_t) v;
+}
+
+/* Pull the tables out of a TZif file that's been read into "data".
+ * We use the 64-bit data from version 2 and up, and the 32-bit data
+ * only for version 1 files.  Returns 0 if the file doesn't make sense.
+ */
+static int parse_tzif(zone *z, unsigned char *data, long size)
+{
+    unsigned char *p = data, *end = data + size;
+    long  counts[6];   // isutcnt isstdcnt leapcnt timecnt typecnt charcnt
+    int   timesize = 4;
+    int   i;
+
+    if ( size < 44 || memcmp(data, "TZif", 4) != 0 )
+        return 0;
+
+    for ( ; ; ) {
+        for (i = 0; i < 6; i++)
+            counts[i] = get_be(p + 20 + 4 * i, 4);
+        p += 44;
+
+        // skip the version 1 data when there's something better after it
+        if ( timesize == 4 && data[4] >= '2' ) {
+            p += counts[3] * 5 + counts[4] * 6 + counts[5]
+                 + counts[2] * 8 + counts[1] + counts[0];
+            if ( p + 44 > end || memcmp(p, "TZif", 4) != 0 )
+                return 0;
+            timesize = 8;
+            continue;
+        }
+        break;
+    }
+
+    if ( counts[4] < 1 || counts[5] < 1 ||
+         p + counts[3] * (timesize + 1) + counts[4] * 6 + counts[5] > end )
+        return 0;
+
+    z->ntrans = counts[3];
+    z->ntypes = counts[4];
+    z->trans = malloc(sizeof(int64_t) * (z->ntrans + 1));
+    z->types_at = malloc(z->ntrans + 1);
+    z->types = malloc(sizeof(struct zonetype) * z->ntypes);
+    z->abbrs = malloc(counts[5] + 1);
+    if ( !z->trans || !z->types_at || !z->types || !z->abbrs )
+        return 0;
+
+    for (i = 0; i < z->ntrans; i++, p += timesize)
+        z->trans[i] = get_be(p, timesize);
+    for (i = 0; i < z->ntrans; i++, p++) {
+        z->types_at[i] = *p;
+        if ( *p >= z->ntypes )
+            return 0;
+    }
+
+    memcpy(z->abbrs, p + z->ntypes * 6, counts[5]);
+    z->abbrs[counts[5]] = '\0';
+    for (i = 0; i < z->ntypes; i++, p += 6) {
+        z->types[i].gmtoff = (long) get_be(p, 4);
+        z->types[i].isdst = p[4];
+        z->types[i].abbr = z->abbrs + ( p[5] < counts[5] ? p[5] : 0 );
+    }
+    p += counts[5] + counts[2] * (timesize + 4) + counts[1] + counts[0];
+
+    // version 2+ files end with "\nRULE\n"
+    if ( timesize == 8 && p < end && *p == '\n' ) {
+        char  footer[64];
+        unsigned char *nl = memchr(p + 1, '\n', end - p - 1);
+        long  len = nl ? nl - p - 1 : 0;
+
+        if ( len > 0 && len < (long) sizeof(footer) ) {
+            memcpy(footer, p + 1, len);
+            footer[len] = '\0';
+            z->has_rule = parse_rule(footer, &z->rule);
+        }
+    }
+
+    return 1;
+}
+
+static int read_zone_file(zone *z, char *path)
+{
+    FILE          *f;
+    unsigned char *data;
+    long           size;
+    int            ok = 0;
+
+    if ( ( f = fopen(path, "r") ) == NULL )
+        return 0;
+
+    if ( fseek(f, 0, SEEK_END) == 0 && ( size = ftell(f) ) > 0 &&
+         fseek(f, 0, SEEK_SET) == 0 && ( data = malloc(size) ) != NULL ) {
+        if ( fread(data, 1, size, f) == (size_t) size )
+            ok = parse_tzif(z, data, size);
+        free(data);
+    }
+    fclose(f);
+
+    return ok;
+}
+
+// load_zone(), with the list of zones locked
+static zone *find_zone(char *name)
+{
+    char  path[4096];
+    char *dir = getenv("TZDIR");
+    zone *z;
+
+    for (z = zones; z != NULL; z = z->next) {
+        if ( strcmp(z->name, name) == 0 )
+            return z;
+    }
+
+    // don't let a zone name wander out of the zone directory
+    if ( name[0] == '\0' || strstr(name, "..") != NULL )
+        return NULL;
+
+    if ( name[0] == '/' )
+        snprintf(path, sizeof(path), "%s", name);
+    else
+        snprintf(path, sizeof(path), "%s/%s",
+                 dir ? dir : "/usr/share/zoneinfo", name);
+
+    if ( ( z = calloc(1, sizeof(*z)) ) == NULL )
+        return NULL;
+    if ( ! read_zone_file(z, path) || ( z->name = strdup(name) ) == NULL ) {
+        free(z->trans);
+        free(z->types_at);
+        free(z->types);
+        free(z->abbrs);
+        free(z);
+        return NULL;
+    }
+
+    z->next = zones;
+    zones = z;
+
+    return z;
+}
+
+/* Find zone "name" (like "Asia/Tokyo"), reading it the first time.
+ * Files come from $TZDIR, or /usr/share/zoneinfo.  Returns NULL if
+ * there's no such zone.  Clocks on other threads can load zones too.
+ */
+zone *load_zone(char *name)
+{
+    zone *z;
+
+    pthread_mutex_lock(&zones_lock);
+    z = find_zone(name);
+    pthread_mutex_unlock(&zones_lock);
+
+    return z;
+}
+
+char *zone_name(zone *z)
+{
+    return z->name;
+}
+
+/* Fill in "tm" with the local time in zone "z" at "t". */
+void zone_time(zone *z, time_t t, struct tm *tm)
+{
+    struct zonetype *type;
+    int              lo, hi, mid;
+
+    if ( z->ntrans == 0 || t < z->trans[0] ) {
+        // before the first transition; tzfile(5) says use type 0
+        type = &z->types[0];
+    } else if ( t >= z->trans[z->ntrans - 1] && z->has_rule ) {
+        type = rule_type(&z->rule, t);
+    } else {
+        // the last transition at or before t
+        lo = 0;
+        hi = z->ntrans - 1;
+        while ( lo < hi ) {
+            mid = (lo + hi + 1) / 2;
+            if ( z->trans[mid] <= t )
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        type = &z->types[z->types_at[lo]];
+    }
+
+    fill_tm(t, type, tm);
+}